@@ -0,0 +1,152 @@
+#pragma once
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <memory>
+#include <string>
+#include <string_view>
+#include "cmd.hpp"
+
+namespace cmd {
+
+namespace internal {
+
+/// Writes events in the Chrome trace-event JSON format, that can be opened in chrome://tracing or https://ui.perfetto.dev
+class ChromeTraceWriter {
+public:
+    explicit ChromeTraceWriter(std::filesystem::path const& path)
+        : _file{path}
+    {
+        _file << "[\n";
+    }
+
+    ~ChromeTraceWriter()
+    {
+        _file << "\n]\n";
+    }
+
+    ChromeTraceWriter(ChromeTraceWriter const&)                    = delete;
+    auto operator=(ChromeTraceWriter const&) -> ChromeTraceWriter& = delete;
+    ChromeTraceWriter(ChromeTraceWriter&&)                         = delete;
+    auto operator=(ChromeTraceWriter&&) -> ChromeTraceWriter&      = delete;
+
+    auto is_open() const -> bool { return _file.is_open(); }
+
+    /// Writes a "complete" event, i.e. a span that has a beginning and a duration.
+    void write_span(std::string_view name, std::string_view category, InstrumentationClock::time_point begin, InstrumentationClock::time_point end)
+    {
+        if (!_is_first_event)
+            _file << ",\n";
+        _is_first_event = false;
+
+        _file << R"({"name":")";
+        write_escaped(name);
+        _file << R"(","cat":")";
+        write_escaped(category);
+        _file << R"(","ph":"X","pid":1,"tid":1,"ts":)"
+              << std::fixed << std::setprecision(3) << as_microseconds(begin - _origin)
+              << R"(,"dur":)" << as_microseconds(end - begin)
+              << "}";
+    }
+
+private:
+    static auto as_microseconds(InstrumentationClock::duration duration) -> double
+    {
+        return std::chrono::duration<double, std::micro>{duration}.count();
+    }
+
+    void write_escaped(std::string_view str)
+    {
+        for (char const c : str)
+        {
+            switch (c)
+            {
+            case '"': _file << "\\\""; break;
+            case '\\': _file << "\\\\"; break;
+            case '\n': _file << "\\n"; break;
+            case '\t': _file << "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20)
+                    _file << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c) << std::dec << std::setfill(' ');
+                else
+                    _file << c;
+            }
+        }
+    }
+
+private:
+    std::ofstream                    _file;
+    InstrumentationClock::time_point _origin{InstrumentationClock::now()};
+    bool                             _is_first_event{true};
+};
+
+} // namespace internal
+
+/// An HistoryObserver that records spans for each group that is moved forward / backward, for each command that is executed / reverted,
+/// and for each save / load, and writes them to a file in the Chrome trace-event JSON format.
+/// Open that file in chrome://tracing or https://ui.perfetto.dev to see exactly which command of which group was expensive.
+/// Does nothing until you call `start_recording()`.
+template<CommandC CommandT>
+class ChromeTracer {
+public:
+    /// Gives the name that will be displayed in the trace for each command.
+    using Labeler = std::function<std::string(CommandT const&)>;
+
+    ChromeTracer() = default;
+    ChromeTracer(std::filesystem::path const& path, Labeler labeler)
+    {
+        start_recording(path, std::move(labeler));
+    }
+
+    /// The file is only complete once `stop_recording()` is called (or the tracer, and all the copies of the history that use it, are destroyed).
+    void start_recording(std::filesystem::path const& path, Labeler labeler)
+    {
+        _writer  = std::make_shared<internal::ChromeTraceWriter>(path);
+        _labeler = std::move(labeler);
+    }
+    void stop_recording() { _writer.reset(); }
+    auto is_recording() const -> bool { return _writer != nullptr; }
+
+    // ---Observer API---
+    void on_push(CommandT const&, InstrumentationClock::time_point) {}
+    void on_merge(bool, InstrumentationClock::time_point) {}
+    void on_new_group(InstrumentationClock::time_point) {}
+    void on_eviction(size_t, InstrumentationClock::time_point) {}
+    void on_execute(CommandT const& command, InstrumentationClock::time_point begin, InstrumentationClock::time_point end) const
+    {
+        if (_writer)
+            _writer->write_span(_labeler(command), "execute", begin, end);
+    }
+    void on_revert(CommandT const& command, InstrumentationClock::time_point begin, InstrumentationClock::time_point end) const
+    {
+        if (_writer)
+            _writer->write_span(_labeler(command), "revert", begin, end);
+    }
+    void on_move_forward(size_t commands_count, InstrumentationClock::time_point begin, InstrumentationClock::time_point end) const
+    {
+        if (_writer)
+            _writer->write_span("move_forward (" + std::to_string(commands_count) + " commands)", "history", begin, end);
+    }
+    void on_move_backward(size_t commands_count, InstrumentationClock::time_point begin, InstrumentationClock::time_point end) const
+    {
+        if (_writer)
+            _writer->write_span("move_backward (" + std::to_string(commands_count) + " commands)", "history", begin, end);
+    }
+    void on_save(InstrumentationClock::time_point begin, InstrumentationClock::time_point end) const
+    {
+        if (_writer)
+            _writer->write_span("save", "serialization", begin, end);
+    }
+    void on_load(InstrumentationClock::time_point begin, InstrumentationClock::time_point end) const
+    {
+        if (_writer)
+            _writer->write_span("load", "serialization", begin, end);
+    }
+
+private:
+    std::shared_ptr<internal::ChromeTraceWriter> _writer{}; // Shared so that clones of the history write to the same file
+    Labeler                                      _labeler{};
+};
+
+} // namespace cmd
@@ -1,4 +1,10 @@
 #pragma once
 #include "../../src/Command.hpp"
+#include "../../src/DeltaCommand.hpp"
 #include "../../src/Executor.hpp"
-#include "../../src/History.hpp"
\ No newline at end of file
+#include "../../src/History.hpp"
+#include "../../src/HistoryManager.hpp"
+#include "../../src/HistoryObserver.hpp"
+#include "../../src/PayloadStore.hpp"
+#include "../../src/StaticHistory.hpp"
+#include "../../src/UndoTree.hpp"
\ No newline at end of file
@@ -2,24 +2,41 @@
 #include <iomanip>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <vector>
 #include "cmd.hpp"
 
 namespace cmd {
 
 namespace internal {
 
-template<typename T>
-auto size_as_string(float multiplier) -> std::string
+inline auto size_as_string(size_t size_in_bytes) -> std::string
 {
-    const auto total_size_in_kilobytes = static_cast<float>(sizeof(T))
-                                         * multiplier
-                                         / 1000.f;
     // return std::format("{:.2f} Mb", total_size_in_megabytes); // Compilers don't support std::format() just yet :(
     std::stringstream stream;
-    stream << std::fixed << std::setprecision(1) << total_size_in_kilobytes << " Kb";
+    stream << std::fixed << std::setprecision(1);
+    if (size_in_bytes < 1'000'000)
+        stream << static_cast<float>(size_in_bytes) / 1'000.f << " Kb";
+    else
+        stream << static_cast<float>(size_in_bytes) / 1'000'000.f << " Mb";
     return stream.str();
 }
 
+/// What we know about the memory currently used by an history, to estimate how much it would use with another max size
+struct HistoryMemoryUsage {
+    size_t size_in_bytes;
+    size_t commits_count;
+};
+
+/// Assumes that the commits we don't have yet will be as big as the current ones on average. O(1).
+template<CommandC CommandT>
+auto projected_size_in_bytes(HistoryMemoryUsage const& current, size_t commits_count) -> size_t
+{
+    if (current.commits_count == 0) // We don't know anything about the commands, so we assume that each commit contains a single one
+        return commits_count * (sizeof(std::vector<CommandT>) + sizeof(CommandT));
+    return static_cast<size_t>(static_cast<double>(current.size_in_bytes) / static_cast<double>(current.commits_count) * static_cast<double>(commits_count));
+}
+
 inline void imgui_help_marker(const char* text)
 {
     ImGui::SameLine();
@@ -40,7 +57,7 @@ struct InputResult {
 };
 
 template<CommandC CommandT>
-inline auto imgui_input_history_size(size_t* value, size_t previous_value, int uuid)
+inline auto imgui_input_history_size(size_t* value, size_t previous_value, int uuid, HistoryMemoryUsage const& memory_usage)
 {
     static_assert(sizeof(size_t) == 8, "The ImGui widget expects a u64 integer");
     ImGui::PushID(uuid);
@@ -52,68 +69,88 @@ inline auto imgui_input_history_size(size_t* value, size_t previous_value, int u
         .is_item_active                 = ImGui::IsItemActive(),
     };
     ImGui::SameLine();
-    ImGui::Text("commits (%s)", internal::size_as_string<CommandT>(static_cast<float>(*value)).c_str());
+    ImGui::Text("commits (%s)", internal::size_as_string(internal::projected_size_in_bytes<CommandT>(memory_usage, *value)).c_str());
     if (*value != previous_value)
     {
         ImGui::TextDisabled("Previously: %zu", previous_value);
     }
+    ImGui::TextDisabled("Currently: %zu commits (%s)", memory_usage.commits_count, internal::size_as_string(memory_usage.size_in_bytes).c_str());
     return ret;
 }
 
 } // namespace internal
 
+inline void imgui_show_stats(HistoryStats const& stats)
+{
+    const auto as_milliseconds = [](InstrumentationClock::duration duration) {
+        return std::chrono::duration<double, std::milli>{duration}.count();
+    };
+    ImGui::Text("Pushes: %zu", stats.pushes_count());
+    ImGui::Text("Merge hit rate: %.1f%% (%zu / %zu)", 100.f * stats.merge_hit_rate(), stats.merge_hits_count(), stats.merge_attempts_count());
+    ImGui::Text("Groups created: %zu", stats.groups_count());
+    ImGui::Text("Average group size: %.2f commands", stats.average_group_size());
+    ImGui::Text("Commits evicted: %zu", stats.commits_evicted_count());
+    ImGui::Text("Commits compacted: %zu (%.3f ms)", stats.commits_compacted_count(), as_milliseconds(stats.time_spent_compacting()));
+    ImGui::Text("Time spent executing: %.3f ms (%zu commands)", as_milliseconds(stats.time_spent_executing()), stats.executed_commands_count());
+    ImGui::Text("Time spent reverting: %.3f ms (%zu commands)", as_milliseconds(stats.time_spent_reverting()), stats.reverted_commands_count());
+}
+
 struct UiForHistory {
     bool   should_scroll_to_current_commit{true};
     size_t uncommited_max_size{};
 
-    template<CommandC CommandT, typename MergerT>
+    template<CommandC CommandT, typename ObserverT, typename AllocatorT, typename MergerT>
         requires MergerC<MergerT, CommandT>
-    void push(History<CommandT>& history, const CommandT& command, const MergerT& merger)
+    void push(History<CommandT, ObserverT, AllocatorT>& history, const CommandT& command, const MergerT& merger)
     {
         should_scroll_to_current_commit = true;
         history.push(command, merger);
     }
 
-    template<CommandC CommandT, typename MergerT>
+    template<CommandC CommandT, typename ObserverT, typename AllocatorT, typename MergerT>
         requires MergerC<MergerT, CommandT>
-    void push(History<CommandT>& history, CommandT&& command, const MergerT& merger)
+    void push(History<CommandT, ObserverT, AllocatorT>& history, CommandT&& command, const MergerT& merger)
     {
         should_scroll_to_current_commit = true;
         history.push(std::move(command), merger);
     }
 
-    template<CommandC CommandT, typename ExecutorT>
+    template<CommandC CommandT, typename ObserverT, typename AllocatorT, typename ExecutorT>
         requires ExecutorC<ExecutorT, CommandT>
-    void move_forward(History<CommandT>& history, ExecutorT& executor)
+    void move_forward(History<CommandT, ObserverT, AllocatorT>& history, ExecutorT& executor)
     {
         should_scroll_to_current_commit = true;
         history.move_forward(executor);
     }
 
-    template<CommandC CommandT, typename ReverterT>
+    template<CommandC CommandT, typename ObserverT, typename AllocatorT, typename ReverterT>
         requires ReverterC<ReverterT, CommandT>
-    void move_backward(History<CommandT>& history, ReverterT& reverter)
+    void move_backward(History<CommandT, ObserverT, AllocatorT>& history, ReverterT& reverter)
     {
         should_scroll_to_current_commit = true;
         history.move_backward(reverter);
     }
 
-    template<CommandC CommandT, typename CommandToString>
-    void imgui_show(const History<CommandT>& history, CommandToString&& command_to_string)
+    /// `command_to_string` can return anything that converts to a std::string_view (std::string, const char*, etc.).
+    /// NB: showing an history doesn't allocate, so if you return a std::string_view or a const char* from `command_to_string` nothing will be allocated every frame.
+    template<CommandC CommandT, typename ObserverT, typename AllocatorT, typename CommandToString>
+    void imgui_show(const History<CommandT, ObserverT, AllocatorT>& history, CommandToString&& command_to_string)
     {
         auto const& command_groups           = history.underlying_container();
         bool        drawn                    = false;
         auto const  draw_position_in_history = [&]() {
             ImGui::Separator();
+            if (auto const progress = history.transition_progress())
+                ImGui::TextDisabled("%s... %.0f%%", progress->is_moving_forward ? "Redoing" : "Undoing", 100.f * progress->ratio());
             if (should_scroll_to_current_commit)
             {
                 ImGui::SetScrollHereY(1.0f);
                 should_scroll_to_current_commit = false;
             }
         };
-        for (auto it = command_groups.cbegin(); it != command_groups.cend(); ++it)
+        for (auto it = command_groups.begin(); it != command_groups.end(); ++it)
         {
-            if (it == history.current_command_group_iterator())
+            if (it.index() == history.current_command_group_index())
             {
                 draw_position_in_history();
                 drawn = true;
@@ -122,12 +159,18 @@ struct UiForHistory {
             {
                 ImGui::TextUnformatted("Group:");
                 for (auto const& command : *it)
-                    ImGui::TextUnformatted(fmt::format("    {}", command_to_string(command)).c_str());
+                {
+                    decltype(auto) text = command_to_string(command);
+                    auto const     view = std::string_view{text};
+                    ImGui::Text("    %.*s", static_cast<int>(view.size()), view.data());
+                }
             }
             else
             {
                 assert(!it->empty());
-                ImGui::TextUnformatted(command_to_string((*it)[0]).c_str());
+                decltype(auto) text = command_to_string((*it)[0]);
+                auto const     view = std::string_view{text};
+                ImGui::TextUnformatted(view.data(), view.data() + view.size());
             }
         }
         if (!drawn)
@@ -136,8 +179,37 @@ struct UiForHistory {
         }
     }
 
-    template<CommandC CommandT>
-    auto imgui_max_size(History<CommandT>& history, std::function<void(const char*)> help_marker) -> bool
+    /// A slider to scrub through time: dragging it moves the history to how it was at that time (see `History::move_to_time()`).
+    /// Returns true iff the history has moved.
+    /// NB: the history must record the commit times, see `History::set_records_commit_times()`.
+    template<CommandC CommandT, typename ObserverT, typename AllocatorT, typename ExecutorT>
+        requires ExecutorC<ExecutorT, CommandT> && ReverterC<ExecutorT, CommandT>
+    auto imgui_timeline(History<CommandT, ObserverT, AllocatorT>& history, ExecutorT& executor) -> bool
+    {
+        if (!history.records_commit_times())
+        {
+            ImGui::TextDisabled("The history doesn't record the commit times");
+            return false;
+        }
+        if (history.size() == 0 || history.is_in_transition())
+            return false;
+        auto const now         = InstrumentationClock::now();
+        auto const seconds_ago = [&](InstrumentationClock::time_point time) { return std::chrono::duration<float>{now - time}.count(); };
+        auto const max_value   = seconds_ago(history.commit_metadata(0).creation_time) + 1.f; // Leaves some room before the oldest commit, so that we can go back to before it
+        auto const index       = history.current_command_group_index();
+        auto       value       = index == 0 ? max_value : seconds_ago(history.commit_metadata(index - 1).creation_time);
+        ImGui::PushID(1473286);
+        auto const has_changed = ImGui::SliderFloat("##timeline", &value, max_value, 0.f, "%.1f s ago"); // Reversed range, so that the most recent commits are on the right
+        ImGui::PopID();
+        if (!has_changed)
+            return false;
+        history.move_to_time(now - std::chrono::duration_cast<InstrumentationClock::duration>(std::chrono::duration<float>{value}), executor);
+        should_scroll_to_current_commit = true;
+        return true;
+    }
+
+    template<CommandC CommandT, typename ObserverT, typename AllocatorT>
+    auto imgui_max_size(History<CommandT, ObserverT, AllocatorT>& history, std::function<void(const char*)> help_marker) -> bool
     {
         ImGui::Text("History maximum size");
         help_marker(
@@ -147,7 +219,8 @@ struct UiForHistory {
         const auto res = internal::imgui_input_history_size<CommandT>(
             &uncommited_max_size,
             history.max_size(),
-            1354321
+            1354321,
+            {.size_in_bytes = history.memory_usage(), .commits_count = history.size()}
         );
         if (res.is_item_deactivated_after_edit)
         {
@@ -169,7 +242,7 @@ struct UiForHistory {
     }
 };
 
-template<CommandC CommandT>
+template<CommandC CommandT, HistoryObserverC<CommandT> ObserverT = NoHistoryObserver, typename AllocatorT = std::allocator<CommandT>>
 class HistoryWithUi {
 public:
     template<typename CommandToString>
@@ -179,10 +252,22 @@ public:
     }
 
     auto imgui_max_size() -> bool { return _ui.imgui_max_size(_history); }
+    template<typename ExecutorT>
+        requires ExecutorC<ExecutorT, CommandT> && ReverterC<ExecutorT, CommandT>
+    auto imgui_timeline(ExecutorT& executor) -> bool
+    {
+        return _ui.imgui_timeline(_history, executor);
+    }
+
+    void imgui_stats()
+        requires std::same_as<ObserverT, HistoryStats>
+    {
+        imgui_show_stats(_history.observer());
+    }
 
     // ---Boilerplate to replicate the API of an History---
-    explicit HistoryWithUi(size_t max_size = 1000)
-        : _history{max_size} {}
+    explicit HistoryWithUi(size_t max_size = 1000, ObserverT observer = {}, AllocatorT const& allocator = {})
+        : _history{max_size, std::move(observer), allocator} {}
     template<typename MergerT>
         requires MergerC<MergerT, CommandT>
     void push(const CommandT& command, const MergerT& merger)
@@ -195,6 +280,20 @@ public:
     {
         _ui.push(_history, std::move(command), merger);
     }
+    template<typename MergerT>
+        requires MergerC<MergerT, CommandT>
+    void push_batch(std::span<CommandT const> commands, const MergerT& merger)
+    {
+        _ui.should_scroll_to_current_commit = true;
+        _history.push_batch(commands, merger);
+    }
+    template<std::input_iterator Iterator, std::sentinel_for<Iterator> Sentinel, typename MergerT>
+        requires MergerC<MergerT, CommandT> && std::constructible_from<CommandT, std::iter_reference_t<Iterator>>
+    void push_batch(Iterator first, Sentinel last, const MergerT& merger)
+    {
+        _ui.should_scroll_to_current_commit = true;
+        _history.push_batch(std::move(first), std::move(last), merger);
+    }
     template<typename ExecutorT>
         requires ExecutorC<ExecutorT, CommandT>
     void move_forward(ExecutorT& executor)
@@ -207,14 +306,53 @@ public:
     {
         _ui.move_backward(_history, reverter);
     }
+    template<typename ExecutorT>
+        requires ExecutorC<ExecutorT, CommandT>
+    auto move_forward_sliced(ExecutorT& executor, SliceBudget const& budget) -> bool
+    {
+        _ui.should_scroll_to_current_commit = true;
+        return _history.move_forward_sliced(executor, budget);
+    }
+    template<typename ReverterT>
+        requires ReverterC<ReverterT, CommandT>
+    auto move_backward_sliced(ReverterT& reverter, SliceBudget const& budget) -> bool
+    {
+        _ui.should_scroll_to_current_commit = true;
+        return _history.move_backward_sliced(reverter, budget);
+    }
+    template<typename ExecutorT>
+        requires ExecutorC<ExecutorT, CommandT> && ReverterC<ExecutorT, CommandT>
+    void cancel_transition(ExecutorT& executor)
+    {
+        _history.cancel_transition(executor);
+    }
+    auto is_in_transition() const -> bool { return _history.is_in_transition(); }
+    auto transition_progress() const -> std::optional<TransitionProgress> { return _history.transition_progress(); }
+    void set_records_commit_times(bool records_commit_times) { _history.set_records_commit_times(records_commit_times); }
+    auto records_commit_times() const -> bool { return _history.records_commit_times(); }
     void dont_merge_next_command() const { _history.dont_merge_next_command(); }
 
     void start_new_commands_group() { _history.start_new_commands_group(); }
+
+    template<typename MergerT>
+        requires MergerC<MergerT, CommandT>
+    auto compact_old_commits(const MergerT& merger, CompactionPolicy const& policy, size_t max_folds_count = 1) -> size_t
+    {
+        return _history.compact_old_commits(merger, policy, max_folds_count);
+    }
+    void set_compaction_policy(std::optional<CompactionPolicy> policy) { _history.set_compaction_policy(policy); }
+    auto evict_oldest_commit() -> size_t { return _history.evict_oldest_commit(); }
+    auto memory_usage() const -> size_t { return _history.memory_usage(); }
+
+    auto size() const -> size_t { return _history.size(); }
+
+    auto observer() const -> ObserverT const& { return _history.observer(); }
+    auto observer() -> ObserverT& { return _history.observer(); }
     // ---End of boilerplate---
 
 private:
-    History<CommandT> _history;
-    UiForHistory      _ui{};
+    History<CommandT, ObserverT, AllocatorT> _history;
+    UiForHistory                             _ui{};
 };
 
 } // namespace cmd
\ No newline at end of file
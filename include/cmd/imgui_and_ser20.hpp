@@ -9,8 +9,8 @@ namespace cmd {
 struct MaxSavedSizeWidget {
     size_t uncommited_max_saved_size{};
 
-    template<CommandC CommandT>
-    auto imgui(SerializationForHistory& serializer, std::function<void(const char*)> const& help_marker) -> bool
+    template<CommandC CommandT, typename ObserverT, typename AllocatorT>
+    auto imgui(SerializationForHistory& serializer, History<CommandT, ObserverT, AllocatorT> const& history, std::function<void(const char*)> const& help_marker) -> bool
     {
         ImGui::Text("History saved size");
         help_marker(
@@ -20,7 +20,8 @@ struct MaxSavedSizeWidget {
         const auto res = internal::imgui_input_history_size<CommandT>(
             &uncommited_max_saved_size,
             serializer.max_saved_size,
-            1782167841
+            1782167841,
+            {.size_in_bytes = history.memory_usage(), .commits_count = history.size()}
         );
         if (res.is_item_deactivated_after_edit)
         {
@@ -34,7 +35,7 @@ struct MaxSavedSizeWidget {
     }
 };
 
-template<CommandC CommandT>
+template<CommandC CommandT, HistoryObserverC<CommandT> ObserverT = NoHistoryObserver, typename AllocatorT = std::allocator<CommandT>>
 class HistoryWithUiAndSerialization {
 public:
     template<typename CommandToString>
@@ -44,12 +45,24 @@ public:
     }
 
     auto imgui_max_size(std::function<void(const char*)> help_marker = &internal::imgui_help_marker) -> bool { return _ui.imgui_max_size(_history, help_marker); }
-    auto imgui_max_saved_size(std::function<void(const char*)> help_marker = &internal::imgui_help_marker) -> bool { return _max_saved_size_widget.imgui<CommandT>(_serialization, help_marker); }
+    auto imgui_max_saved_size(std::function<void(const char*)> help_marker = &internal::imgui_help_marker) -> bool { return _max_saved_size_widget.imgui(_serialization, _history, help_marker); }
     void set_max_saved_size(size_t size) { _serialization.max_saved_size = size; }
+    void set_serialization_thread_pool(SerializationThreadPool* thread_pool) { _serialization.thread_pool = thread_pool; }
+    template<typename ExecutorT>
+        requires ExecutorC<ExecutorT, CommandT> && ReverterC<ExecutorT, CommandT>
+    auto imgui_timeline(ExecutorT& executor) -> bool
+    {
+        return _ui.imgui_timeline(_history, executor);
+    }
+    void imgui_stats()
+        requires std::same_as<ObserverT, HistoryStats>
+    {
+        imgui_show_stats(_history.observer());
+    }
 
     // ---Boilerplate to replicate the API of an History---
-    explicit HistoryWithUiAndSerialization(size_t max_size = 1000)
-        : _history{max_size} {}
+    explicit HistoryWithUiAndSerialization(size_t max_size = 1000, ObserverT observer = {}, AllocatorT const& allocator = {})
+        : _history{max_size, std::move(observer), allocator} {}
     template<typename MergerT>
         requires MergerC<MergerT, CommandT>
     void push(const CommandT& command, const MergerT& merger)
@@ -62,6 +75,20 @@ public:
     {
         _ui.push(_history, std::move(command), merger);
     }
+    template<typename MergerT>
+        requires MergerC<MergerT, CommandT>
+    void push_batch(std::span<CommandT const> commands, const MergerT& merger)
+    {
+        _ui.should_scroll_to_current_commit = true;
+        _history.push_batch(commands, merger);
+    }
+    template<std::input_iterator Iterator, std::sentinel_for<Iterator> Sentinel, typename MergerT>
+        requires MergerC<MergerT, CommandT> && std::constructible_from<CommandT, std::iter_reference_t<Iterator>>
+    void push_batch(Iterator first, Sentinel last, const MergerT& merger)
+    {
+        _ui.should_scroll_to_current_commit = true;
+        _history.push_batch(std::move(first), std::move(last), merger);
+    }
     template<typename ExecutorT>
         requires ExecutorC<ExecutorT, CommandT>
     void move_forward(ExecutorT& executor)
@@ -74,18 +101,55 @@ public:
     {
         _ui.move_backward(_history, reverter);
     }
+    template<typename ExecutorT>
+        requires ExecutorC<ExecutorT, CommandT>
+    auto move_forward_sliced(ExecutorT& executor, SliceBudget const& budget) -> bool
+    {
+        _ui.should_scroll_to_current_commit = true;
+        return _history.move_forward_sliced(executor, budget);
+    }
+    template<typename ReverterT>
+        requires ReverterC<ReverterT, CommandT>
+    auto move_backward_sliced(ReverterT& reverter, SliceBudget const& budget) -> bool
+    {
+        _ui.should_scroll_to_current_commit = true;
+        return _history.move_backward_sliced(reverter, budget);
+    }
+    template<typename ExecutorT>
+        requires ExecutorC<ExecutorT, CommandT> && ReverterC<ExecutorT, CommandT>
+    void cancel_transition(ExecutorT& executor)
+    {
+        _history.cancel_transition(executor);
+    }
+    auto is_in_transition() const -> bool { return _history.is_in_transition(); }
+    auto transition_progress() const -> std::optional<TransitionProgress> { return _history.transition_progress(); }
+    void set_records_commit_times(bool records_commit_times) { _history.set_records_commit_times(records_commit_times); }
+    auto records_commit_times() const -> bool { return _history.records_commit_times(); }
     void dont_merge_next_command() const { _history.dont_merge_next_command(); }
 
     void start_new_commands_group() { _history.start_new_commands_group(); }
 
+    template<typename MergerT>
+        requires MergerC<MergerT, CommandT>
+    auto compact_old_commits(const MergerT& merger, CompactionPolicy const& policy, size_t max_folds_count = 1) -> size_t
+    {
+        return _history.compact_old_commits(merger, policy, max_folds_count);
+    }
+    void set_compaction_policy(std::optional<CompactionPolicy> policy) { _history.set_compaction_policy(policy); }
+    auto evict_oldest_commit() -> size_t { return _history.evict_oldest_commit(); }
+    auto memory_usage() const -> size_t { return _history.memory_usage(); }
+
     auto size() const -> size_t { return _history.size(); }
+
+    auto observer() const -> ObserverT const& { return _history.observer(); }
+    auto observer() -> ObserverT& { return _history.observer(); }
     // ---End of boilerplate---
 
 private:
-    History<CommandT>       _history;
-    UiForHistory            _ui{};
-    MaxSavedSizeWidget      _max_saved_size_widget{};
-    SerializationForHistory _serialization{};
+    History<CommandT, ObserverT, AllocatorT> _history;
+    UiForHistory                             _ui{};
+    MaxSavedSizeWidget                       _max_saved_size_widget{};
+    SerializationForHistory                  _serialization{};
 
 private:
     friend class ser20::access;
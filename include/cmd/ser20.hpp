@@ -1,28 +1,592 @@
 #pragma once
-#include <ser20/types/list.hpp>
+#include <algorithm>
+#include <any>
+#include <atomic>
+#include <concepts>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <istream>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <span>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+#include <ser20/types/memory.hpp>
 #include <ser20/types/optional.hpp>
+#include <ser20/types/vector.hpp>
 #include "cmd.hpp"
 
+namespace ser20 {
+class PortableBinaryOutputArchive; // Only used to recognize them, so we don't need to include <ser20/archives/portable_binary.hpp>
+class PortableBinaryInputArchive;
+} // namespace ser20
+
 namespace cmd {
 
+/// A fixed set of threads that SerializationForHistory can use to save and load big histories in parallel chunks (see `SerializationForHistory::thread_pool`).
+/// The threads are started once by the constructor, so create the pool once and reuse it for all your saves and loads.
+/// NB: it can be used by several threads at the same time, but they then take turns.
+class SerializationThreadPool {
+public:
+    /// The thread that calls `for_each_index()` takes part in the work, so this starts `threads_count - 1` threads
+    explicit SerializationThreadPool(size_t threads_count = std::max(std::thread::hardware_concurrency(), 1u))
+    {
+        _workers.reserve(threads_count > 0 ? threads_count - 1 : 0);
+        for (size_t i = 1; i < threads_count; ++i)
+            _workers.emplace_back([this]() { run_worker(); });
+    }
+
+    ~SerializationThreadPool()
+    {
+        {
+            auto const lock = std::lock_guard{_mutex};
+            _should_stop    = true;
+        }
+        _job_available.notify_all();
+        _workers.clear(); // Joins them
+    }
+
+    SerializationThreadPool(SerializationThreadPool const&)                    = delete;
+    auto operator=(SerializationThreadPool const&) -> SerializationThreadPool& = delete;
+
+    auto threads_count() const -> size_t { return _workers.size() + 1; }
+
+    /// Calls `task(index)` for each index in [0, count), on all the threads of the pool, and returns once they are all done.
+    /// If some calls throw, the first exception is rethrown once all the threads are done.
+    /// When called from one of the tasks, the indices are processed on the current thread only.
+    template<typename Task>
+    void for_each_index(size_t count, Task const& task)
+    {
+        auto       next_index     = std::atomic<size_t>{0};
+        auto       exception      = std::exception_ptr{};
+        auto       exception_lock = std::mutex{};
+        auto const work           = [&]() {
+            auto const is_running_a_task = RunningATask{};
+            for (auto index = next_index++; index < count; index = next_index++)
+            {
+                try
+                {
+                    task(index);
+                }
+                catch (...)
+                {
+                    auto const lock = std::lock_guard{exception_lock};
+                    if (!exception)
+                        exception = std::current_exception();
+                }
+            }
+        };
+
+        if (_workers.empty() || count < 2 || _is_running_a_task)
+        {
+            work();
+        }
+        else
+        {
+            auto const one_job_at_a_time = std::lock_guard{_job_mutex};
+            {
+                auto const lock         = std::lock_guard{_mutex};
+                _job                    = std::ref(work);
+                _finished_workers_count = 0;
+                _job_generation++;
+            }
+            _job_available.notify_all();
+            work();
+            auto lock = std::unique_lock{_mutex};
+            _job_done.wait(lock, [&]() { return _finished_workers_count == _workers.size(); }); // `work` must outlive all the workers that use it
+            _job = nullptr;
+        }
+        if (exception)
+            std::rethrow_exception(exception);
+    }
+
+private:
+    class RunningATask {
+    public:
+        RunningATask()
+            : _was_running_a_task{_is_running_a_task}
+        {
+            _is_running_a_task = true;
+        }
+        ~RunningATask() { _is_running_a_task = _was_running_a_task; } // Nested calls must not reset it before the outer task is done
+        RunningATask(RunningATask const&)                    = delete;
+        auto operator=(RunningATask const&) -> RunningATask& = delete;
+
+    private:
+        bool _was_running_a_task;
+    };
+
+    void run_worker()
+    {
+        auto last_generation = uint64_t{0};
+        auto lock            = std::unique_lock{_mutex};
+        while (true)
+        {
+            _job_available.wait(lock, [&]() { return _should_stop || _job_generation != last_generation; });
+            if (_should_stop)
+                return;
+            last_generation = _job_generation;
+            auto const job  = _job;
+            lock.unlock();
+            job();
+            lock.lock();
+            if (++_finished_workers_count == _workers.size())
+                _job_done.notify_one();
+        }
+    }
+
+private:
+    static inline thread_local bool _is_running_a_task{false}; // Nested calls don't wait for the other threads, which are busy running the outer call
+
+    std::mutex                _job_mutex{};
+    std::mutex                _mutex{}; // Protects all the members below
+    std::condition_variable   _job_available{};
+    std::condition_variable   _job_done{};
+    std::function<void()>     _job{};
+    uint64_t                  _job_generation{0};
+    size_t                    _finished_workers_count{0};
+    bool                      _should_stop{false};
+    std::vector<std::jthread> _workers{}; // Last, so that the other members are still alive while the threads are joined
+};
+
+namespace internal {
+
+/// Observers can optionally be notified of saves and loads, by providing `on_save(begin, end)` and `on_load(begin, end)`
+template<typename ObserverT>
+void notify_save(ObserverT const& observer, InstrumentationClock::time_point begin)
+{
+    if constexpr (requires { observer.on_save(begin, begin); })
+        observer.on_save(begin, now<ObserverT>());
+}
+
+template<typename ObserverT>
+void notify_load(ObserverT const& observer, InstrumentationClock::time_point begin)
+{
+    if constexpr (requires { observer.on_load(begin, begin); })
+        observer.on_load(begin, now<ObserverT>());
+}
+
+template<typename Archive>
+concept IsPortableArchive = std::same_as<Archive, ser20::PortableBinaryOutputArchive>
+                            || std::same_as<Archive, ser20::PortableBinaryInputArchive>;
+
+/// Binary archives write trivially copyable commands as one flat block of bytes, plus a table with the size of each group, instead of writing them one by one.
+/// This is an order of magnitude faster. Text archives (e.g. JSON) keep writing each command, so their format doesn't change.
+/// The bytes are written as is, so portable archives keep writing each command too: they can't depend on the endianness and the layout of CommandT.
+/// The block is marked with a tag and a version, so files that were written one command at a time before can still be loaded.
+template<typename Archive, typename CommandT>
+concept CanSaveCommandsAsBinaryBlock = std::is_trivially_copyable_v<CommandT>
+                                       && !IsPortableArchive<Archive>
+                                       && ser20::traits::is_output_serializable<ser20::BinaryData<uint8_t const*>, Archive>::value;
+
+template<typename Archive, typename CommandT>
+concept CanLoadCommandsAsBinaryBlock = std::is_trivially_copyable_v<CommandT>
+                                       && std::is_default_constructible_v<CommandT>
+                                       && !IsPortableArchive<Archive>
+                                       && ser20::traits::is_input_serializable<ser20::BinaryData<uint8_t*>, Archive>::value;
+
+inline constexpr ser20::size_type binary_block_format_tag     = std::numeric_limits<ser20::size_type>::max(); // Written instead of the number of commits, which can't be that big
+inline constexpr uint32_t         binary_block_format_version = 1;
+inline constexpr size_t           max_bytes_per_read          = 1 << 20;
+
+/// Reads `count` trivially copyable values that have been written as one block of bytes, and appends them to `values`.
+/// The count comes from the input, and archives can't tell us how many bytes are left in it, so we read at most max_bytes_per_read bytes at a time:
+/// if the count has been corrupted the archive throws once it reaches the end of the input, before we allocate much more memory than the input contains.
+template<class Archive, typename T>
+void load_values_as_binary_block(Archive& archive, std::vector<T>& values, uint64_t count)
+{
+    auto const values_per_read = std::max<uint64_t>(max_bytes_per_read / sizeof(T), 1);
+    while (count > 0)
+    {
+        auto const read_count = static_cast<size_t>(std::min(count, values_per_read));
+        auto const first      = values.size();
+        values.resize(first + read_count);
+        archive(ser20::binary_data(values.data() + first, read_count * sizeof(T))); // Typed, so that portable archives know the size of the values whose bytes they might need to swap
+        count -= read_count;
+    }
+}
+
+template<typename CommandT, class Archive, typename CommandGroups>
+void save_commands_as_binary_block(Archive& archive, CommandGroups const& command_groups)
+{
+    auto group_sizes = std::vector<uint64_t>{};
+    group_sizes.reserve(command_groups.size());
+    for (auto const& group : command_groups)
+        group_sizes.push_back(group.size());
+
+    archive(ser20::make_size_tag(binary_block_format_tag));
+    archive(binary_block_format_version);
+    archive(ser20::make_size_tag(static_cast<ser20::size_type>(group_sizes.size())));
+    archive(ser20::binary_data(reinterpret_cast<uint8_t const*>(group_sizes.data()), group_sizes.size() * sizeof(uint64_t)));
+    for (auto const& group : command_groups) // All the groups end up in a single flat block
+        archive(ser20::binary_data(reinterpret_cast<uint8_t const*>(group.data()), group.size() * sizeof(CommandT)));
+}
+
+template<class Archive, typename CommandGroup>
+void load_commands_as_binary_block(Archive& archive, std::vector<CommandGroup>& command_groups, typename CommandGroup::allocator_type const& allocator)
+{
+    using CommandT = typename CommandGroup::value_type;
+    ser20::size_type groups_count_or_format_tag{};
+    archive(ser20::make_size_tag(groups_count_or_format_tag));
+    if (groups_count_or_format_tag != binary_block_format_tag) // The commands have been written one by one
+    {
+        for (ser20::size_type i = 0; i < groups_count_or_format_tag; ++i)
+            archive(command_groups.emplace_back(allocator));
+        return;
+    }
+    uint32_t version{};
+    archive(version);
+    if (version != binary_block_format_version)
+        throw ser20::Exception{"Unsupported version of the format of the commands of the history: " + std::to_string(version)};
+
+    ser20::size_type groups_count{};
+    archive(ser20::make_size_tag(groups_count));
+    auto group_sizes = std::vector<uint64_t>{};
+    load_values_as_binary_block(archive, group_sizes, groups_count);
+
+    auto commands_count = uint64_t{0};
+    for (auto const group_size : group_sizes)
+    {
+        if (group_size > std::numeric_limits<uint64_t>::max() / sizeof(CommandT) - commands_count)
+            throw ser20::Exception{"Invalid size of commands group: " + std::to_string(group_size)};
+        commands_count += group_size;
+    }
+    auto commands = std::vector<CommandT>{};
+    load_values_as_binary_block(archive, commands, commands_count);
+
+    command_groups.reserve(group_sizes.size());
+    auto group_begin = commands.begin();
+    for (auto const group_size : group_sizes)
+    {
+        auto const group_end = group_begin + static_cast<std::ptrdiff_t>(group_size);
+        command_groups.emplace_back(group_begin, group_end, allocator);
+        group_begin = group_end;
+    }
+}
+
+/// Binary archives that can be created on top of a std::ostream / std::istream (e.g. ser20::BinaryOutputArchive and ser20::PortableBinaryOutputArchive) can encode big histories of commands that are not trivially copyable in independent chunks of commits, in parallel.
+/// This is opt-in: it is only done when a SerializationThreadPool is given to SerializationForHistory, and the serialize() functions of the commands then run on the threads of that pool.
+/// Each chunk is written with its own archive, and the chunks are preceded by an index with the number of commits and bytes of each chunk, so that loading can decode them in parallel too.
+/// The commits are split in chunks of a fixed size, independently of the number of threads, so the output is deterministic.
+/// NB: ser20 only deduplicates shared pointers inside of a given archive, so a std::shared_ptr used by commands of several chunks is written once per chunk, and loaded as a separate copy in each chunk.
+/// Only the Interned payloads are shared across chunks: they are written once in a table that precedes the chunks, and the chunks only refer to them by index.
+/// When loading, the chunks are decoded with std::allocator and the commands are only moved to the allocator of the history on the calling thread, so that allocator doesn't need to be thread-safe (e.g. a std::pmr::monotonic_buffer_resource).
+/// Smaller histories are written one command at a time, like with the other archives. The chunks are marked with a tag and a version, so files that were written before can still be loaded, and files written with chunks can be loaded without a pool too.
+template<typename Archive, typename CommandT>
+concept CanSaveCommandsInParallelChunks = !CanSaveCommandsAsBinaryBlock<Archive, CommandT>
+                                          && std::constructible_from<Archive, std::ostream&>
+                                          && ser20::traits::is_output_serializable<ser20::BinaryData<uint8_t const*>, Archive>::value;
+
+template<typename Archive, typename CommandT>
+concept CanLoadCommandsInParallelChunks = !CanLoadCommandsAsBinaryBlock<Archive, CommandT>
+                                          && std::constructible_from<Archive, std::istream&>
+                                          && ser20::traits::is_input_serializable<ser20::BinaryData<uint8_t*>, Archive>::value;
+
+inline constexpr size_t           commits_per_serialization_chunk            = 1024;
+inline constexpr size_t           min_commits_count_to_serialize_in_parallel = 2 * commits_per_serialization_chunk; // Below that, starting threads isn't worth it
+inline constexpr ser20::size_type parallel_chunks_format_tag                 = std::numeric_limits<ser20::size_type>::max(); // Written instead of the number of commits, which can't be that big
+inline constexpr uint32_t         parallel_chunks_format_version             = 1;
+
+struct SerializationChunkInfo {
+    uint64_t              commits_count;
+    uint64_t              size_in_bytes;
+    std::vector<uint64_t> payloads; // The indices in the table of shared payloads of the payloads that the chunk refers to
+};
+
+/// Runs the tasks on the pool if there is one, and on the current thread otherwise
+template<typename Task>
+void for_each_index(SerializationThreadPool* thread_pool, size_t count, Task const& task)
+{
+    if (thread_pool)
+    {
+        thread_pool->for_each_index(count, task);
+        return;
+    }
+    for (size_t index = 0; index < count; ++index)
+        task(index);
+}
+
+/// Lets an input archive read from a block of memory without copying it
+class MemoryStreambuf : public std::streambuf {
+public:
+    explicit MemoryStreambuf(std::span<char> bytes)
+    {
+        setg(bytes.data(), bytes.data(), bytes.data() + bytes.size());
+    }
+};
+
+/// Makes a value available to the serialization functions that run on the current thread, as long as the scope is alive
+template<typename T>
+class CurrentOnThisThread {
+public:
+    explicit CurrentOnThisThread(T* value)
+        : _previous{_current}
+    {
+        _current = value;
+    }
+    ~CurrentOnThisThread() { _current = _previous; }
+    CurrentOnThisThread(CurrentOnThisThread const&)                    = delete;
+    auto operator=(CurrentOnThisThread const&) -> CurrentOnThisThread& = delete;
+
+    static auto get() -> T* { return _current; }
+
+private:
+    static inline thread_local T* _current{nullptr};
+    T*                            _previous;
+};
+
+/// The payloads that a chunk refers to while it is being written, in the order in which it first refers to them
+class PayloadsOfChunkWriter {
+public:
+    /// Returns the index that the chunk uses to refer to the payload. 0 is the empty handle.
+    template<typename PayloadT, typename EncodePayload>
+    auto index_of(std::shared_ptr<PayloadT const> const& payload, EncodePayload&& encode_payload) -> uint64_t
+    {
+        if (!payload)
+            return 0;
+        auto const [it, is_new] = _index_of_payload.try_emplace(payload.get(), _payloads.size() + 1);
+        if (is_new)
+            _payloads.push_back({payload.get(), std::forward<EncodePayload>(encode_payload)});
+        return it->second;
+    }
+
+    struct Payload {
+        void const*                  address;
+        std::function<std::string()> encode;
+    };
+    auto payloads() const -> std::vector<Payload> const& { return _payloads; }
+
+private:
+    std::vector<Payload>                      _payloads{};
+    std::unordered_map<void const*, uint64_t> _index_of_payload{};
+};
+
+struct PayloadsOfChunkReader;
+
+/// The payloads are decoded the first time a chunk refers to them, and shared by all the chunks
+class SharedPayloadsTable {
+public:
+    explicit SharedPayloadsTable(std::vector<std::vector<char>> encoded_payloads)
+        : _encoded_payloads{std::move(encoded_payloads)}
+        , _decoded_payloads(_encoded_payloads.size())
+        , _decoding_flags{std::make_unique<std::once_flag[]>(_encoded_payloads.size())}
+    {}
+
+    template<typename PayloadT, typename Archive>
+    auto get(uint64_t index) -> Interned<PayloadT>
+    {
+        if (index >= _encoded_payloads.size())
+            throw ser20::Exception{"Invalid index of shared payload: " + std::to_string(index)};
+        std::call_once(_decoding_flags[index], [&]() {
+            auto const outside_of_chunk = CurrentOnThisThread<PayloadsOfChunkReader>{nullptr}; // The payload has been written with its own archive
+            auto       streambuf        = MemoryStreambuf{std::span<char>{_encoded_payloads[index]}};
+            auto       stream           = std::istream{&streambuf};
+            auto       payload_archive  = Archive{stream};
+            auto       payload          = std::make_unique<PayloadT>();
+            payload_archive(*payload);
+            _decoded_payloads[index] = PayloadStore<PayloadT>::global().intern(std::move(payload));
+        });
+        return std::any_cast<Interned<PayloadT>>(_decoded_payloads[index]);
+    }
+
+private:
+    std::vector<std::vector<char>>    _encoded_payloads;
+    std::vector<std::any>             _decoded_payloads;
+    std::unique_ptr<std::once_flag[]> _decoding_flags;
+};
+
+struct PayloadsOfChunkReader {
+    SharedPayloadsTable*      table;
+    std::span<uint64_t const> payloads; // Same as SerializationChunkInfo::payloads
+
+    /// `index` is the one written by PayloadsOfChunkWriter::index_of()
+    template<typename PayloadT, typename Archive>
+    auto get(uint64_t index) const -> Interned<PayloadT>
+    {
+        if (index == 0)
+            return Interned<PayloadT>{};
+        if (index > payloads.size())
+            throw ser20::Exception{"Invalid index of payload in chunk: " + std::to_string(index)};
+        return table->get<PayloadT, Archive>(payloads[index - 1]);
+    }
+};
+
+template<class Archive, typename CommandGroups>
+void save_commands_in_parallel_chunks(Archive& archive, CommandGroups const& command_groups, SerializationThreadPool* thread_pool)
+{
+    if (!thread_pool || command_groups.size() < min_commits_count_to_serialize_in_parallel)
+    {
+        archive(ser20::make_nvp("Commits", command_groups));
+        return;
+    }
+
+    auto const chunks_count      = (command_groups.size() + commits_per_serialization_chunk - 1) / commits_per_serialization_chunk;
+    auto       chunks            = std::vector<std::string>(chunks_count);
+    auto       payloads_of_chunk = std::vector<PayloadsOfChunkWriter>(chunks_count);
+    thread_pool->for_each_index(chunks_count, [&](size_t chunk_index) {
+        auto const first    = chunk_index * commits_per_serialization_chunk;
+        auto const last     = std::min(first + commits_per_serialization_chunk, command_groups.size());
+        auto       stream   = std::ostringstream{std::ios::out | std::ios::binary};
+        auto const payloads = CurrentOnThisThread<PayloadsOfChunkWriter>{&payloads_of_chunk[chunk_index]};
+        {
+            auto chunk_archive = Archive{stream};
+            for (size_t i = first; i < last; ++i)
+                chunk_archive(command_groups[i]);
+        } // Some archives only finish writing when they are destroyed
+        chunks[chunk_index] = std::move(stream).str();
+    });
+
+    // The payloads are numbered in the order of the chunks that use them, so the output is still deterministic
+    auto shared_payloads  = std::vector<std::string>{};
+    auto index_of_payload = std::unordered_map<void const*, uint64_t>{};
+    auto index            = std::vector<SerializationChunkInfo>{};
+    index.reserve(chunks_count);
+    for (size_t i = 0; i < chunks_count; ++i)
+    {
+        auto& chunk = index.emplace_back(SerializationChunkInfo{
+            .commits_count = std::min(commits_per_serialization_chunk, command_groups.size() - i * commits_per_serialization_chunk),
+            .size_in_bytes = chunks[i].size(),
+            .payloads      = {},
+        });
+        for (auto const& payload : payloads_of_chunk[i].payloads())
+        {
+            auto const [it, is_new] = index_of_payload.try_emplace(payload.address, shared_payloads.size());
+            if (is_new)
+                shared_payloads.push_back(payload.encode());
+            chunk.payloads.push_back(it->second);
+        }
+    }
+
+    archive(ser20::make_size_tag(parallel_chunks_format_tag));
+    archive(parallel_chunks_format_version);
+    archive(ser20::make_size_tag(static_cast<ser20::size_type>(shared_payloads.size())));
+    for (auto const& payload : shared_payloads)
+    {
+        archive(ser20::make_size_tag(static_cast<ser20::size_type>(payload.size())));
+        archive(ser20::binary_data(reinterpret_cast<uint8_t const*>(payload.data()), payload.size()));
+    }
+    archive(ser20::make_size_tag(static_cast<ser20::size_type>(chunks_count)));
+    for (auto const& chunk : index) // Not as a block of bytes, so that portable archives take care of the endianness
+        archive(chunk.commits_count, chunk.size_in_bytes, chunk.payloads);
+    for (auto const& chunk : chunks)
+        archive(ser20::binary_data(reinterpret_cast<uint8_t const*>(chunk.data()), chunk.size()));
+}
+
+template<class Archive, typename CommandGroup>
+void load_commands_in_parallel_chunks(Archive& archive, std::vector<CommandGroup>& command_groups, typename CommandGroup::allocator_type const& allocator, SerializationThreadPool* thread_pool)
+{
+    ser20::size_type commits_count_or_format_tag{};
+    archive(ser20::make_size_tag(commits_count_or_format_tag));
+    if (commits_count_or_format_tag != parallel_chunks_format_tag) // The commands have been written one by one
+    {
+        for (ser20::size_type i = 0; i < commits_count_or_format_tag; ++i)
+            archive(command_groups.emplace_back(allocator));
+        return;
+    }
+    uint32_t version{};
+    archive(version);
+    if (version != parallel_chunks_format_version)
+        throw ser20::Exception{"Unsupported version of the format of the commands of the history: " + std::to_string(version)};
+
+    // All the counts and sizes come from the input, so we never allocate for them up front (see load_values_as_binary_block())
+    ser20::size_type shared_payloads_count{};
+    archive(ser20::make_size_tag(shared_payloads_count));
+    auto encoded_payloads = std::vector<std::vector<char>>{};
+    for (ser20::size_type i = 0; i < shared_payloads_count; ++i)
+    {
+        ser20::size_type size{};
+        archive(ser20::make_size_tag(size));
+        load_values_as_binary_block(archive, encoded_payloads.emplace_back(), size);
+    }
+    auto shared_payloads = SharedPayloadsTable{std::move(encoded_payloads)};
+
+    ser20::size_type chunks_count{};
+    archive(ser20::make_size_tag(chunks_count));
+    auto index = std::vector<SerializationChunkInfo>{};
+    for (ser20::size_type i = 0; i < chunks_count; ++i)
+    {
+        auto& chunk = index.emplace_back();
+        archive(chunk.commits_count, chunk.size_in_bytes);
+        ser20::size_type payloads_count{};
+        archive(ser20::make_size_tag(payloads_count));
+        load_values_as_binary_block(archive, chunk.payloads, payloads_count);
+        if (chunk.commits_count > commits_per_serialization_chunk) // Otherwise we could loop for a long time on an empty chunk
+            throw ser20::Exception{"Invalid number of commits in chunk: " + std::to_string(chunk.commits_count)};
+    }
+
+    auto commits_count       = size_t{0};
+    auto first_byte_of_chunk = std::vector<size_t>{}; // The offsets of the chunks in `bytes`
+    first_byte_of_chunk.reserve(index.size() + 1);
+    first_byte_of_chunk.push_back(0);
+    for (auto const& chunk : index)
+    {
+        if (chunk.size_in_bytes > std::numeric_limits<size_t>::max() - first_byte_of_chunk.back())
+            throw ser20::Exception{"Invalid size of chunk: " + std::to_string(chunk.size_in_bytes)};
+        commits_count += static_cast<size_t>(chunk.commits_count);
+        first_byte_of_chunk.push_back(first_byte_of_chunk.back() + static_cast<size_t>(chunk.size_in_bytes));
+    }
+    auto bytes = std::vector<char>{};
+    load_values_as_binary_block(archive, bytes, first_byte_of_chunk.back());
+
+    using CommandT      = typename CommandGroup::value_type;
+    auto decoded_chunks = std::vector<std::vector<std::vector<CommandT>>>(index.size()); // Not with the allocator of the history, which might not be thread-safe
+    for_each_index(thread_pool, index.size(), [&](size_t chunk_index) {
+        auto       payloads_of_chunk = PayloadsOfChunkReader{.table = &shared_payloads, .payloads = index[chunk_index].payloads};
+        auto const payloads          = CurrentOnThisThread<PayloadsOfChunkReader>{&payloads_of_chunk};
+        auto       streambuf         = MemoryStreambuf{std::span<char>{bytes}.subspan(first_byte_of_chunk[chunk_index], static_cast<size_t>(index[chunk_index].size_in_bytes))};
+        auto       stream            = std::istream{&streambuf};
+        auto       chunk_archive     = Archive{stream};
+        auto&      groups            = decoded_chunks[chunk_index];
+        groups.resize(static_cast<size_t>(index[chunk_index].commits_count));
+        for (auto& group : groups)
+            chunk_archive(group);
+    });
+
+    command_groups.reserve(commits_count);
+    for (auto& groups : decoded_chunks)
+    {
+        for (auto& group : groups)
+        {
+            if constexpr (std::is_same_v<CommandGroup, std::vector<CommandT>>)
+                command_groups.push_back(std::move(group));
+            else
+                command_groups.emplace_back(std::make_move_iterator(group.begin()), std::make_move_iterator(group.end()), allocator);
+        }
+    }
+}
+
+} // namespace internal
+
 struct SerializationForHistory {
-    size_t max_saved_size{100};
+    size_t                   max_saved_size{100};
+    SerializationThreadPool* thread_pool{nullptr}; // When set, big histories are saved and loaded in parallel chunks, on the threads of the pool (see CanSaveCommandsInParallelChunks)
 
-    template<class Archive, CommandC CommandT>
-    void save(Archive& archive, const History<CommandT>& history) const
+    template<class Archive, CommandC CommandT, typename ObserverT, typename AllocatorT>
+    void save(Archive& archive, const History<CommandT, ObserverT, AllocatorT>& history) const
     {
-        auto copy = history.clone(); // We make a copy because we don't want to shrink the actual history,
-        copy.shrink(max_saved_size); // in case it is still used even after being serialized
-                                     // TODO(JF) performance could be improved by only copying the commits that we want to serialize. Currently we copy all the commits and then discard many of them in shrink()
+        auto copy = history.clone(); // We make a copy because we don't want to shrink the actual history, in case it is still used even after being serialized
+        copy.shrink(max_saved_size); // This is cheap: the clone shares its commits with the history, and shrinking it only copies the chunks at its boundaries
+        auto const pool = internal::CurrentOnThisThread<SerializationThreadPool>{thread_pool};
         archive(
             ser20::make_nvp("History", copy),
             ser20::make_nvp("Max saved size", max_saved_size)
         );
     }
 
-    template<class Archive, CommandC CommandT>
-    void load(Archive& archive, History<CommandT>& history)
+    template<class Archive, CommandC CommandT, typename ObserverT, typename AllocatorT>
+    void load(Archive& archive, History<CommandT, ObserverT, AllocatorT>& history)
     {
+        auto const pool = internal::CurrentOnThisThread<SerializationThreadPool>{thread_pool};
         archive(
             history,
             max_saved_size
@@ -30,12 +594,12 @@ struct SerializationForHistory {
     }
 };
 
-template<CommandC CommandT>
+template<CommandC CommandT, HistoryObserverC<CommandT> ObserverT = NoHistoryObserver, typename AllocatorT = std::allocator<CommandT>>
 class HistoryWithSerialization {
 public:
     // ---Boilerplate to replicate the API of an History---
-    explicit HistoryWithSerialization(size_t max_size = 1000)
-        : _history{max_size} {}
+    explicit HistoryWithSerialization(size_t max_size = 1000, ObserverT observer = {}, AllocatorT const& allocator = {})
+        : _history{max_size, std::move(observer), allocator} {}
     template<typename MergerT>
         requires MergerC<MergerT, CommandT>
     void push(const CommandT& command, const MergerT& merger)
@@ -48,6 +612,18 @@ public:
     {
         _history.push(std::move(command), merger);
     }
+    template<typename MergerT>
+        requires MergerC<MergerT, CommandT>
+    void push_batch(std::span<CommandT const> commands, const MergerT& merger)
+    {
+        _history.push_batch(commands, merger);
+    }
+    template<std::input_iterator Iterator, std::sentinel_for<Iterator> Sentinel, typename MergerT>
+        requires MergerC<MergerT, CommandT> && std::constructible_from<CommandT, std::iter_reference_t<Iterator>>
+    void push_batch(Iterator first, Sentinel last, const MergerT& merger)
+    {
+        _history.push_batch(std::move(first), std::move(last), merger);
+    }
     template<typename ExecutorT>
         requires ExecutorC<ExecutorT, CommandT>
     void move_forward(ExecutorT& executor)
@@ -61,14 +637,45 @@ public:
         _history.move_backward(reverter);
     }
 
+    template<typename ExecutorT>
+        requires ExecutorC<ExecutorT, CommandT>
+    auto move_forward_sliced(ExecutorT& executor, SliceBudget const& budget) -> bool
+    {
+        return _history.move_forward_sliced(executor, budget);
+    }
+    template<typename ReverterT>
+        requires ReverterC<ReverterT, CommandT>
+    auto move_backward_sliced(ReverterT& reverter, SliceBudget const& budget) -> bool
+    {
+        return _history.move_backward_sliced(reverter, budget);
+    }
+    template<typename ExecutorT>
+        requires ExecutorC<ExecutorT, CommandT> && ReverterC<ExecutorT, CommandT>
+    void cancel_transition(ExecutorT& executor)
+    {
+        _history.cancel_transition(executor);
+    }
+    auto is_in_transition() const -> bool { return _history.is_in_transition(); }
+    auto transition_progress() const -> std::optional<TransitionProgress> { return _history.transition_progress(); }
+    void set_serialization_thread_pool(SerializationThreadPool* thread_pool) { _serialization.thread_pool = thread_pool; }
+    void set_records_commit_times(bool records_commit_times) { _history.set_records_commit_times(records_commit_times); }
+    auto records_commit_times() const -> bool { return _history.records_commit_times(); }
     void dont_merge_next_command() const { _history.dont_merge_next_command(); }
 
     void start_new_commands_group() { _history.start_new_commands_group(); }
+
+    auto evict_oldest_commit() -> size_t { return _history.evict_oldest_commit(); }
+    auto memory_usage() const -> size_t { return _history.memory_usage(); }
+
+    auto size() const -> size_t { return _history.size(); }
+
+    auto observer() const -> ObserverT const& { return _history.observer(); }
+    auto observer() -> ObserverT& { return _history.observer(); }
     // ---End of boilerplate---
 
 private:
-    History<CommandT>       _history;
-    SerializationForHistory _serialization{};
+    History<CommandT, ObserverT, AllocatorT> _history;
+    SerializationForHistory                  _serialization{};
 
 private:
     friend class ser20::access;
@@ -90,28 +697,95 @@ private:
 
 namespace ser20 {
 
-template<class Archive, cmd::CommandC CommandT>
-void save(Archive& archive, const cmd::History<CommandT>& history)
+/// Same format as a std::list or a std::vector
+template<class Archive, typename T, size_t ChunkSize, typename Allocator>
+void save(Archive& archive, const cmd::internal::CircularBuffer<T, ChunkSize, Allocator>& buffer)
+{
+    archive(ser20::make_size_tag(static_cast<ser20::size_type>(buffer.size())));
+    for (auto const& element : buffer)
+        archive(element);
+}
+
+template<class Archive, cmd::CommandC CommandT, typename ObserverT, typename AllocatorT>
+void save(Archive& archive, const cmd::History<CommandT, ObserverT, AllocatorT>& history)
 {
+    auto const begin = cmd::internal::now<ObserverT>();
+    if constexpr (cmd::internal::CanSaveCommandsAsBinaryBlock<Archive, CommandT>)
+        cmd::internal::save_commands_as_binary_block<CommandT>(archive, history.underlying_container());
+    else if constexpr (cmd::internal::CanSaveCommandsInParallelChunks<Archive, CommandT>)
+        cmd::internal::save_commands_in_parallel_chunks(archive, history.underlying_container(), cmd::internal::CurrentOnThisThread<cmd::SerializationThreadPool>::get());
+    else
+        archive(ser20::make_nvp("Commits", history.underlying_container()));
     archive(
-        ser20::make_nvp("Commits", history.underlying_container()),
         ser20::make_nvp("Position in history", history.unsafe_get_next_command_group_to_execute()),
         ser20::make_nvp("Max size", history.max_size())
     );
+    cmd::internal::notify_save(history.observer(), begin);
 }
 
-template<class Archive, cmd::CommandC CommandT>
-void load(Archive& archive, cmd::History<CommandT>& history)
+template<class Archive, cmd::CommandC CommandT, typename ObserverT, typename AllocatorT>
+void load(Archive& archive, cmd::History<CommandT, ObserverT, AllocatorT>& history)
 {
+    auto const            begin   = cmd::internal::now<ObserverT>();
+    auto                  commits = std::vector<typename cmd::History<CommandT, ObserverT, AllocatorT>::CommandGroup>{};
     std::optional<size_t> next_command_index;
     std::size_t           max_size;
+    if constexpr (cmd::internal::CanLoadCommandsAsBinaryBlock<Archive, CommandT>)
+        cmd::internal::load_commands_as_binary_block(archive, commits, history.get_allocator());
+    else if constexpr (cmd::internal::CanLoadCommandsInParallelChunks<Archive, CommandT>)
+        cmd::internal::load_commands_in_parallel_chunks(archive, commits, history.get_allocator(), cmd::internal::CurrentOnThisThread<cmd::SerializationThreadPool>::get());
+    else
+        archive(commits);
     archive(
-        history.underlying_container(),
         next_command_index,
         max_size
     );
+    history.unsafe_set_command_groups(std::move(commits));
     history.unsafe_set_next_command_group_to_execute(next_command_index);
     history.set_max_size(max_size);
+    cmd::internal::notify_load(history.observer(), begin);
+}
+
+/// ser20 keeps track of the shared pointers it has already written, so each payload is only written once per archive, no matter how many commands use it
+/// When the commands are written in parallel chunks, the payloads are written once in a table shared by all the chunks instead.
+template<class Archive, typename PayloadT>
+void save(Archive& archive, const cmd::Interned<PayloadT>& payload)
+{
+    if constexpr (std::constructible_from<Archive, std::ostream&>)
+    {
+        if (auto* const payloads_of_chunk = cmd::internal::CurrentOnThisThread<cmd::internal::PayloadsOfChunkWriter>::get())
+        {
+            archive(payloads_of_chunk->index_of(payload.unsafe_shared_ptr(), [shared_payload = payload.unsafe_shared_ptr()]() {
+                auto stream = std::ostringstream{std::ios::out | std::ios::binary};
+                {
+                    auto payload_archive = Archive{stream};
+                    payload_archive(*shared_payload);
+                } // Some archives only finish writing when they are destroyed
+                return std::move(stream).str();
+            }));
+            return;
+        }
+    }
+    archive(std::const_pointer_cast<PayloadT>(payload.unsafe_shared_ptr()));
+}
+
+/// The loaded payloads are interned in cmd::PayloadStore<PayloadT>::global()
+template<class Archive, typename PayloadT>
+void load(Archive& archive, cmd::Interned<PayloadT>& payload)
+{
+    if constexpr (std::constructible_from<Archive, std::istream&>)
+    {
+        if (auto const* const payloads_of_chunk = cmd::internal::CurrentOnThisThread<cmd::internal::PayloadsOfChunkReader>::get())
+        {
+            uint64_t index{};
+            archive(index);
+            payload = payloads_of_chunk->get<PayloadT, Archive>(index);
+            return;
+        }
+    }
+    auto loaded_payload = std::shared_ptr<PayloadT>{};
+    archive(loaded_payload);
+    payload = cmd::PayloadStore<PayloadT>::global().intern(std::shared_ptr<PayloadT const>{std::move(loaded_payload)});
 }
 
 } // namespace ser20
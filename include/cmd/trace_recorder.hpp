@@ -0,0 +1,517 @@
+#pragma once
+
+/// Synthetic benchmarks don't reproduce how an history is really used (bursts of merges while dragging a slider, big grouped pastes, long series of undos, etc.).
+/// HistoryWithTraceRecorder records every operation done on an History in a compact binary trace file, with the outcome of each merge.
+/// `replay_trace()` then re-runs that trace against any kind of history (History, UndoTree, StaticHistory, ...), and measures the throughput, the latency percentiles and the peak memory usage.
+/// The trace doesn't contain the commands themselves, only their size: the replay uses TraceCommands of the same size, and a merger that reproduces the recorded outcomes.
+/// All the numbers are encoded as varints, so a trace can be read on a machine with a different endianness than the one that recorded it.
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
+#include "cmd.hpp"
+
+namespace cmd {
+
+enum class TraceEventKind : uint8_t {
+    Push,
+    DontMergeNextCommand,
+    StartNewCommandsGroup,
+    MoveForward,
+    MoveBackward,
+    SetMaxSize,
+};
+
+enum class TraceMergeOutcome : uint8_t {
+    NotTried, // The history didn't try to merge the command, e.g. because `dont_merge_next_command()` had been called
+    NotMerged,
+    Merged,
+    CancelledOut,
+};
+
+struct TraceEvent {
+    TraceEventKind            kind{};
+    std::chrono::microseconds time_since_previous_event{};     // The first event is relative to the start of the recording
+    TraceMergeOutcome         merge_outcome{};                 // Only for Push
+    uint64_t                  command_size_in_bytes{0};        // Only for Push. sizeof(CommandT) + memory_footprint(command), see HasMemoryFootprintC
+    uint64_t                  merged_command_size_in_bytes{0}; // Only for Push when the outcome is Merged
+    uint64_t                  max_size{0};                     // Only for SetMaxSize
+
+    friend auto operator==(TraceEvent const&, TraceEvent const&) -> bool = default;
+};
+
+namespace internal {
+
+inline constexpr std::array<char, 8> trace_magic_number   = {'c', 'm', 'd', 't', 'r', 'a', 'c', 'e'};
+inline constexpr uint8_t             trace_format_version = 1;
+
+/// Each event is written as [kind][time since the previous event, in microseconds][the fields that this kind of event uses], with all the numbers encoded as varints.
+class TraceWriter {
+public:
+    explicit TraceWriter(std::filesystem::path const& path)
+        : _file{path, std::ios::binary}
+    {
+        _buffer.insert(_buffer.end(), trace_magic_number.begin(), trace_magic_number.end());
+        _buffer.push_back(static_cast<char>(trace_format_version));
+    }
+
+    ~TraceWriter()
+    {
+        flush();
+    }
+
+    TraceWriter(TraceWriter const&)                    = delete;
+    auto operator=(TraceWriter const&) -> TraceWriter& = delete;
+    TraceWriter(TraceWriter&&)                         = delete;
+    auto operator=(TraceWriter&&) -> TraceWriter&      = delete;
+
+    auto is_open() const -> bool { return _file.is_open(); }
+
+    /// The time of the event is set by the writer. Pass the time at which the operation started if it has already been done.
+    void write(TraceEvent const& event, InstrumentationClock::time_point time = InstrumentationClock::now())
+    {
+        auto const time_since_previous_event = std::chrono::duration_cast<std::chrono::microseconds>(time - _previous_event_time);
+        _previous_event_time += time_since_previous_event; // Not now(), otherwise the sub-microsecond parts of the durations would be lost for good, and the events that happen in quick succession would all look simultaneous
+        _buffer.push_back(static_cast<char>(event.kind));
+        write_varint(static_cast<uint64_t>(time_since_previous_event.count()));
+        switch (event.kind)
+        {
+        case TraceEventKind::Push:
+            _buffer.push_back(static_cast<char>(event.merge_outcome));
+            write_varint(event.command_size_in_bytes);
+            if (event.merge_outcome == TraceMergeOutcome::Merged)
+                write_varint(event.merged_command_size_in_bytes);
+            break;
+        case TraceEventKind::SetMaxSize:
+            write_varint(event.max_size);
+            break;
+        default:
+            break;
+        }
+        if (_buffer.size() >= buffer_size) // Writing to the file for every event would slow down the history that we are trying to measure
+            flush();
+    }
+
+private:
+    static constexpr size_t buffer_size = 64 * 1024;
+
+    void write_varint(uint64_t n)
+    {
+        while (n >= 0x80)
+        {
+            _buffer.push_back(static_cast<char>((n & 0x7F) | 0x80));
+            n >>= 7;
+        }
+        _buffer.push_back(static_cast<char>(n));
+    }
+
+    void flush()
+    {
+        _file.write(_buffer.data(), static_cast<std::streamsize>(_buffer.size()));
+        _buffer.clear();
+    }
+
+private:
+    std::ofstream                    _file;
+    std::vector<char>                _buffer{};
+    InstrumentationClock::time_point _previous_event_time{InstrumentationClock::now()};
+};
+
+class TraceParser {
+public:
+    explicit TraceParser(std::span<uint8_t const> bytes)
+        : _bytes{bytes}
+    {}
+
+    /// std::nullopt if the trace is malformed
+    auto parse() -> std::optional<std::vector<TraceEvent>>
+    {
+        if (_bytes.size() < trace_magic_number.size() + 1
+            || !std::equal(trace_magic_number.begin(), trace_magic_number.end(), _bytes.begin())
+            || _bytes[trace_magic_number.size()] != trace_format_version)
+        {
+            return std::nullopt;
+        }
+        _position = trace_magic_number.size() + 1;
+
+        auto events = std::vector<TraceEvent>{};
+        while (_position < _bytes.size())
+        {
+            auto event = TraceEvent{};
+            auto kind  = uint8_t{};
+            auto time  = uint64_t{};
+            if (!read_byte(kind) || kind > static_cast<uint8_t>(TraceEventKind::SetMaxSize) || !read_varint(time))
+                return std::nullopt;
+            event.kind                      = static_cast<TraceEventKind>(kind);
+            event.time_since_previous_event = std::chrono::microseconds{static_cast<std::chrono::microseconds::rep>(time)};
+            if (event.kind == TraceEventKind::Push)
+            {
+                auto outcome = uint8_t{};
+                if (!read_byte(outcome) || outcome > static_cast<uint8_t>(TraceMergeOutcome::CancelledOut) || !read_varint(event.command_size_in_bytes))
+                    return std::nullopt;
+                event.merge_outcome = static_cast<TraceMergeOutcome>(outcome);
+                if (event.merge_outcome == TraceMergeOutcome::Merged && !read_varint(event.merged_command_size_in_bytes))
+                    return std::nullopt;
+            }
+            else if (event.kind == TraceEventKind::SetMaxSize && !read_varint(event.max_size))
+            {
+                return std::nullopt;
+            }
+            events.push_back(event);
+        }
+        return events;
+    }
+
+private:
+    auto read_byte(uint8_t& byte) -> bool
+    {
+        if (_position == _bytes.size())
+            return false;
+        byte = _bytes[_position++];
+        return true;
+    }
+
+    auto read_varint(uint64_t& n) -> bool
+    {
+        n = 0;
+        for (int shift = 0; shift < 64; shift += 7)
+        {
+            auto byte = uint8_t{};
+            if (!read_byte(byte))
+                return false;
+            n |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0)
+                return true;
+        }
+        return false;
+    }
+
+private:
+    std::span<uint8_t const> _bytes;
+    size_t                   _position{0};
+};
+
+template<CommandC CommandT>
+auto command_size_in_bytes(CommandT const& command) -> uint64_t
+{
+    return sizeof(CommandT) + memory_footprint_of(command);
+}
+
+/// Forwards to the user's merger, and remembers the outcome of the first merge, which is the one between the pushed command and the last command of the history.
+/// The merges that can happen after that (commuting commands, compaction) are not recorded.
+template<CommandC CommandT, MergerC<CommandT> MergerT>
+class RecordingMerger {
+public:
+    RecordingMerger(MergerT const& merger, TraceEvent& event)
+        : _merger{&merger}
+        , _event{&event}
+    {}
+
+    auto merge(CommandT const& command1, CommandT const& command2) const -> MergeResult<CommandT>
+    {
+        auto res = internal::merge(*_merger, command1, command2);
+        if (_event->merge_outcome == TraceMergeOutcome::NotTried)
+        {
+            _event->merge_outcome = res.cancels_out() ? TraceMergeOutcome::CancelledOut
+                                    : res.is_merged() ? TraceMergeOutcome::Merged
+                                                      : TraceMergeOutcome::NotMerged;
+            if (_event->merge_outcome == TraceMergeOutcome::Merged)
+                _event->merged_command_size_in_bytes = command_size_in_bytes(res.command());
+        }
+        return res;
+    }
+
+    auto commutes(CommandT const& command1, CommandT const& command2) const -> bool
+        requires CommutativityHintC<MergerT, CommandT>
+    {
+        return _merger->commutes(command1, command2);
+    }
+
+private:
+    MergerT const* _merger;
+    TraceEvent*    _event;
+};
+
+} // namespace internal
+
+/// Reads a trace written by HistoryWithTraceRecorder. Returns std::nullopt if the file can't be read or is not a valid trace.
+inline auto read_trace(std::filesystem::path const& path) -> std::optional<std::vector<TraceEvent>>
+{
+    auto file = std::ifstream{path, std::ios::binary};
+    if (!file.is_open())
+        return std::nullopt;
+    auto const bytes = std::vector<uint8_t>{std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+    return internal::TraceParser{bytes}.parse();
+}
+
+/// An History that records all the operations done on it in a trace file, which can then be given to `replay_trace()`.
+/// Does nothing more than an History until you call `start_recording()`.
+template<CommandC CommandT, HistoryObserverC<CommandT> ObserverT = NoHistoryObserver, typename AllocatorT = std::allocator<CommandT>>
+class HistoryWithTraceRecorder {
+public:
+    explicit HistoryWithTraceRecorder(size_t max_size = 1000, ObserverT observer = {}, AllocatorT const& allocator = {})
+        : _history{max_size, std::move(observer), allocator}
+    {}
+
+    /// The file is only complete once `stop_recording()` is called (or the history is destroyed).
+    /// The trace starts with the current max size of the history, so that the replay uses the same one.
+    /// NB: the trace starts from the current state of the history, so you will usually want to start recording on an empty history.
+    void start_recording(std::filesystem::path const& path)
+    {
+        _writer = std::make_unique<internal::TraceWriter>(path);
+        _writer->write(TraceEvent{.kind = TraceEventKind::SetMaxSize, .max_size = _history.max_size()});
+    }
+    void stop_recording() { _writer.reset(); }
+    auto is_recording() const -> bool { return _writer != nullptr; }
+
+    template<typename MergerT>
+        requires MergerC<MergerT, CommandT>
+    void push(const CommandT& command, const MergerT& merger)
+    {
+        push_impl(command, merger);
+    }
+    template<typename MergerT>
+        requires MergerC<MergerT, CommandT>
+    void push(CommandT&& command, const MergerT& merger)
+    {
+        push_impl(std::move(command), merger);
+    }
+    template<typename ExecutorT>
+        requires ExecutorC<ExecutorT, CommandT>
+    void move_forward(ExecutorT& executor)
+    {
+        record(TraceEvent{.kind = TraceEventKind::MoveForward});
+        _history.move_forward(executor);
+    }
+    template<typename ReverterT>
+        requires ReverterC<ReverterT, CommandT>
+    void move_backward(ReverterT& reverter)
+    {
+        record(TraceEvent{.kind = TraceEventKind::MoveBackward});
+        _history.move_backward(reverter);
+    }
+    void dont_merge_next_command() const
+    {
+        record(TraceEvent{.kind = TraceEventKind::DontMergeNextCommand});
+        _history.dont_merge_next_command();
+    }
+    void start_new_commands_group()
+    {
+        record(TraceEvent{.kind = TraceEventKind::StartNewCommandsGroup});
+        _history.start_new_commands_group();
+    }
+    void set_max_size(size_t max_size)
+    {
+        record(TraceEvent{.kind = TraceEventKind::SetMaxSize, .max_size = max_size});
+        _history.set_max_size(max_size);
+    }
+
+    auto size() const -> size_t { return _history.size(); }
+    auto max_size() const -> size_t { return _history.max_size(); }
+    auto memory_usage() const -> size_t { return _history.memory_usage(); }
+    auto current_command_group_index() const -> size_t { return _history.current_command_group_index(); }
+
+    /// Read-only, because the operations that don't go through HistoryWithTraceRecorder can't be recorded
+    auto history() const -> History<CommandT, ObserverT, AllocatorT> const& { return _history; }
+
+    auto observer() const -> ObserverT const& { return _history.observer(); }
+    auto observer() -> ObserverT& { return _history.observer(); }
+
+private:
+    template<typename CommandType, typename MergerT>
+    void push_impl(CommandType&& command, MergerT const& merger)
+    {
+        if (!_writer)
+        {
+            _history.push(std::forward<CommandType>(command), merger);
+            return;
+        }
+        auto const time  = InstrumentationClock::now(); // Like the other events, which are recorded before the operation
+        auto       event = TraceEvent{
+            .kind                  = TraceEventKind::Push,
+            .merge_outcome         = TraceMergeOutcome::NotTried,
+            .command_size_in_bytes = internal::command_size_in_bytes(command),
+        };
+        _history.push(std::forward<CommandType>(command), internal::RecordingMerger<CommandT, MergerT>{merger, event});
+        _writer->write(event, time); // Once the history has told us the outcome of the merge
+    }
+
+    void record(TraceEvent const& event) const
+    {
+        if (_writer)
+            _writer->write(event);
+    }
+
+private:
+    History<CommandT, ObserverT, AllocatorT> _history;
+    std::unique_ptr<internal::TraceWriter>   _writer{};
+};
+
+/// The command used when replaying a trace. It owns as much memory as the command that was recorded.
+class TraceCommand {
+public:
+    TraceCommand() = default;
+    explicit TraceCommand(uint64_t recorded_size_in_bytes)
+        : _payload(static_cast<size_t>(std::max<uint64_t>(recorded_size_in_bytes, sizeof(TraceCommand)) - sizeof(TraceCommand)))
+    {}
+
+    /// See HasMemoryFootprintC
+    friend auto memory_footprint(TraceCommand const& command) -> size_t { return command._payload.capacity(); }
+
+private:
+    std::vector<std::byte> _payload{};
+};
+
+/// Reproduces the merge outcome that was recorded for the command that is being pushed
+class TraceReplayMerger {
+public:
+    explicit TraceReplayMerger(TraceEvent const& event)
+        : _event{&event}
+    {}
+
+    auto merge(TraceCommand const&, TraceCommand const&) const -> MergeResult<TraceCommand>
+    {
+        switch (_event->merge_outcome)
+        {
+        case TraceMergeOutcome::Merged:
+            return TraceCommand{_event->merged_command_size_in_bytes};
+        case TraceMergeOutcome::CancelledOut:
+            return cancel_out;
+        default: // NotTried can happen if the history that we replay on decides to merge when the recorded one didn't
+            return std::nullopt;
+        }
+    }
+
+private:
+    TraceEvent const* _event;
+};
+
+struct TraceReplayExecutor {
+    size_t executed_commands_count{0};
+    size_t reverted_commands_count{0};
+
+    void execute(TraceCommand const&) { executed_commands_count++; }
+    void revert(TraceCommand const&) { reverted_commands_count++; }
+};
+
+struct LatencyPercentiles {
+    size_t                         count{0};
+    InstrumentationClock::duration p50{};
+    InstrumentationClock::duration p90{};
+    InstrumentationClock::duration p99{};
+    InstrumentationClock::duration max{};
+};
+
+struct TraceReplayReport {
+    size_t                         operations_count{0};
+    InstrumentationClock::duration total_duration{};     // Only the time spent inside the history, not the time spent creating the commands that are pushed
+    std::chrono::microseconds      recorded_duration{};  // How long the recording took
+    size_t                         peak_memory_usage{0}; // In bytes, as reported by `memory_usage()`. 0 if the history doesn't have `memory_usage()`.
+    LatencyPercentiles             push{};
+    LatencyPercentiles             move_forward{};
+    LatencyPercentiles             move_backward{};
+    LatencyPercentiles             set_max_size{};
+
+    auto operations_per_second() const -> double
+    {
+        return total_duration == InstrumentationClock::duration{}
+                   ? 0.
+                   : static_cast<double>(operations_count) / std::chrono::duration<double>{total_duration}.count();
+    }
+};
+
+namespace internal {
+
+inline auto latency_percentiles(std::vector<InstrumentationClock::duration>& durations) -> LatencyPercentiles
+{
+    if (durations.empty())
+        return {};
+    std::sort(durations.begin(), durations.end());
+    auto const percentile = [&](size_t percent) { return durations[(durations.size() - 1) * percent / 100]; };
+    return LatencyPercentiles{
+        .count = durations.size(),
+        .p50   = percentile(50),
+        .p90   = percentile(90),
+        .p99   = percentile(99),
+        .max   = durations.back(),
+    };
+}
+
+} // namespace internal
+
+/// Re-runs the operations of a trace on the given history, which must store TraceCommands.
+/// `set_max_size()` events are ignored if the history doesn't have a `set_max_size()` function (e.g. StaticHistory).
+template<typename HistoryT>
+    requires requires(HistoryT history, TraceCommand command, TraceReplayMerger merger, TraceReplayExecutor executor) {
+        history.push(std::move(command), merger);
+        history.move_forward(executor);
+        history.move_backward(executor);
+        history.dont_merge_next_command();
+        history.start_new_commands_group();
+    }
+auto replay_trace(std::span<TraceEvent const> events, HistoryT& history) -> TraceReplayReport
+{
+    auto report   = TraceReplayReport{};
+    auto executor = TraceReplayExecutor{};
+    auto push     = std::vector<InstrumentationClock::duration>{};
+    auto forward  = std::vector<InstrumentationClock::duration>{};
+    auto backward = std::vector<InstrumentationClock::duration>{};
+    auto max_size = std::vector<InstrumentationClock::duration>{};
+    for (auto const& event : events)
+    {
+        auto command = event.kind == TraceEventKind::Push ? TraceCommand{event.command_size_in_bytes} : TraceCommand{};
+        std::vector<InstrumentationClock::duration>* durations = nullptr; // The operations that are not measured only set a flag
+        auto const begin = InstrumentationClock::now();
+        switch (event.kind)
+        {
+        case TraceEventKind::Push:
+            history.push(std::move(command), TraceReplayMerger{event});
+            durations = &push;
+            break;
+        case TraceEventKind::DontMergeNextCommand:
+            history.dont_merge_next_command();
+            break;
+        case TraceEventKind::StartNewCommandsGroup:
+            history.start_new_commands_group();
+            break;
+        case TraceEventKind::MoveForward:
+            history.move_forward(executor);
+            durations = &forward;
+            break;
+        case TraceEventKind::MoveBackward:
+            history.move_backward(executor);
+            durations = &backward;
+            break;
+        case TraceEventKind::SetMaxSize:
+            if constexpr (requires { history.set_max_size(size_t{}); })
+                history.set_max_size(static_cast<size_t>(event.max_size));
+            durations = &max_size;
+            break;
+        }
+        auto const duration = InstrumentationClock::now() - begin;
+        report.operations_count++;
+        report.total_duration += duration;
+        report.recorded_duration += event.time_since_previous_event;
+        if (durations)
+            durations->push_back(duration);
+        if constexpr (requires { history.memory_usage(); })
+            report.peak_memory_usage = std::max(report.peak_memory_usage, static_cast<size_t>(history.memory_usage()));
+    }
+    report.push          = internal::latency_percentiles(push);
+    report.move_forward  = internal::latency_percentiles(forward);
+    report.move_backward = internal::latency_percentiles(backward);
+    report.set_max_size  = internal::latency_percentiles(max_size);
+    return report;
+}
+
+} // namespace cmd
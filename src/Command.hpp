@@ -1,8 +1,31 @@
 #pragma once
+#include <concepts>
+#include <cstddef>
 
 namespace cmd {
 
 template<typename T>
 concept CommandC = true;
 
+/// A command that tells how many bytes of heap memory it owns (e.g. the capacity of its std::vector members), so that `History::memory_usage()` can take them into account.
+/// To opt in, declare `auto memory_footprint(YourCommand const&) -> size_t` next to YourCommand, so that it is found through ADL.
+/// NB: sizeof(YourCommand) is already taken into account by the history, so it must not be included.
+template<typename CommandT>
+concept HasMemoryFootprintC = requires(CommandT const& command) {
+    { memory_footprint(command) } -> std::convertible_to<size_t>;
+};
+
+namespace internal {
+
+template<typename CommandT>
+auto memory_footprint_of(CommandT const& command) -> size_t
+{
+    if constexpr (HasMemoryFootprintC<CommandT>)
+        return static_cast<size_t>(memory_footprint(command));
+    else
+        return 0;
+}
+
+} // namespace internal
+
 } // namespace cmd
\ No newline at end of file
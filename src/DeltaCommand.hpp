@@ -0,0 +1,361 @@
+#pragma once
+
+/// A DeltaCommand stores the difference between the previous and the new value of an object, instead of storing both values.
+/// This is meant for big objects like gradients, curves or images, where an edit usually only changes a small part of the object:
+/// the command then costs memory proportional to what actually changed.
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <ranges>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "Command.hpp"
+#include "Executor.hpp"
+
+namespace cmd {
+
+/// Either a trivially copyable object, or a resizable contiguous container of trivially copyable elements (e.g. std::vector<float>, std::string).
+template<typename T>
+concept DeltaCompatibleC = std::is_trivially_copyable_v<T>
+                           || (std::ranges::contiguous_range<T>
+                               && std::ranges::sized_range<T>
+                               && std::is_trivially_copyable_v<std::ranges::range_value_t<T>>
+                               && requires(T value, size_t size) { value.resize(size); });
+
+namespace internal {
+
+template<typename T>
+constexpr bool is_resizable_container = !std::is_trivially_copyable_v<T>;
+
+template<DeltaCompatibleC T>
+auto as_bytes(T const& value) -> std::span<uint8_t const>
+{
+    if constexpr (is_resizable_container<T>)
+        return {reinterpret_cast<uint8_t const*>(std::ranges::data(value)), std::ranges::size(value) * sizeof(std::ranges::range_value_t<T>)};
+    else
+        return {reinterpret_cast<uint8_t const*>(&value), sizeof(T)};
+}
+
+template<DeltaCompatibleC T>
+auto as_writable_bytes(T& value) -> std::span<uint8_t>
+{
+    if constexpr (is_resizable_container<T>)
+        return {reinterpret_cast<uint8_t*>(std::ranges::data(value)), std::ranges::size(value) * sizeof(std::ranges::range_value_t<T>)};
+    else
+        return {reinterpret_cast<uint8_t*>(&value), sizeof(T)};
+}
+
+/// New elements must be zero-initialized, which is what value-initialization does for trivially copyable types.
+template<DeltaCompatibleC T>
+void resize_bytes(T& value, size_t size_in_bytes)
+{
+    if constexpr (is_resizable_container<T>)
+        value.resize(size_in_bytes / sizeof(std::ranges::range_value_t<T>));
+    else
+        assert(size_in_bytes == sizeof(T));
+}
+
+/// A XorPatch is the XOR of two byte buffers (the shortest one being padded with zeros), compressed by only storing the runs of non-zero bytes.
+/// It is encoded as a sequence of [number of zero bytes to skip][number of bytes in the run][the bytes of the run], with the numbers encoded as varints.
+class XorPatchWriter {
+public:
+    /// Offsets must be strictly increasing. Zero bytes don't need to be written, but they are allowed.
+    void write(size_t offset, uint8_t byte)
+    {
+        if (byte == 0)
+            return;
+        auto const run_end = _run_begin + _run.size();
+        if (!_run.empty() && offset - run_end <= max_zeros_in_a_run)
+        {
+            _run.resize(offset - _run_begin, 0); // It is cheaper to store a few zeros than to start a new run
+        }
+        else
+        {
+            flush();
+            _run_begin = offset;
+        }
+        _run.push_back(byte);
+    }
+
+    auto finish() && -> std::vector<uint8_t>
+    {
+        flush();
+        _patch.shrink_to_fit();
+        return std::move(_patch);
+    }
+
+private:
+    static constexpr size_t max_zeros_in_a_run = 3; // Starting a new run costs at least 2 bytes
+
+    void flush()
+    {
+        if (_run.empty())
+            return;
+        write_varint(_run_begin - _end_of_previous_run);
+        write_varint(_run.size());
+        _patch.insert(_patch.end(), _run.begin(), _run.end());
+        _end_of_previous_run = _run_begin + _run.size();
+        _run.clear();
+    }
+
+    void write_varint(size_t n)
+    {
+        while (n >= 0x80)
+        {
+            _patch.push_back(static_cast<uint8_t>(n | 0x80));
+            n >>= 7;
+        }
+        _patch.push_back(static_cast<uint8_t>(n));
+    }
+
+private:
+    std::vector<uint8_t> _patch{};
+    std::vector<uint8_t> _run{};
+    size_t               _run_begin{0};
+    size_t               _end_of_previous_run{0};
+};
+
+/// Iterates over the bytes stored in a XorPatch, in increasing offsets.
+/// Throws std::out_of_range if the patch is malformed (e.g. it has been corrupted before being loaded), instead of reading past its end.
+class XorPatchReader {
+public:
+    explicit XorPatchReader(std::span<uint8_t const> patch)
+        : _patch{patch}
+    {
+        start_next_run();
+    }
+
+    auto is_done() const -> bool { return _remaining_in_run == 0; }
+    auto offset() const -> size_t { return _offset; }
+    auto byte() const -> uint8_t { return _patch[_position]; }
+
+    void next()
+    {
+        _position++;
+        _offset++;
+        _remaining_in_run--;
+        if (_remaining_in_run == 0)
+            start_next_run();
+    }
+
+    /// Calls `callback(offset, run)` for each run of bytes and consumes the whole patch
+    template<typename Callback>
+    void for_each_run(Callback&& callback)
+    {
+        while (!is_done())
+        {
+            callback(_offset, _patch.subspan(_position, _remaining_in_run));
+            _position += _remaining_in_run;
+            _offset += _remaining_in_run;
+            start_next_run();
+        }
+    }
+
+private:
+    void start_next_run()
+    {
+        if (_position == _patch.size())
+        {
+            _remaining_in_run = 0;
+            return;
+        }
+        auto const zeros_count = read_varint();
+        _remaining_in_run      = read_varint();
+        if (zeros_count > std::numeric_limits<size_t>::max() - _offset
+            || _remaining_in_run > std::numeric_limits<size_t>::max() - _offset - zeros_count // The offsets of the run must not overflow
+            || _remaining_in_run == 0
+            || _remaining_in_run > _patch.size() - _position)
+        {
+            throw std::out_of_range{"Malformed XorPatch"};
+        }
+        _offset += zeros_count;
+    }
+
+    auto read_varint() -> size_t
+    {
+        size_t res   = 0;
+        int    shift = 0;
+        while (true)
+        {
+            if (_position == _patch.size() || shift >= std::numeric_limits<size_t>::digits)
+                throw std::out_of_range{"Malformed XorPatch"};
+            auto const byte = _patch[_position++];
+            res |= static_cast<size_t>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0)
+                return res;
+            shift += 7;
+        }
+    }
+
+private:
+    std::span<uint8_t const> _patch;
+    size_t                   _position{0};
+    size_t                   _offset{0};
+    size_t                   _remaining_in_run{0};
+};
+
+/// Throws std::out_of_range if applying the patch would write past the end of a buffer of the given size
+inline void check_xor_patch_fits(std::span<uint8_t const> patch, size_t size_in_bytes)
+{
+    XorPatchReader{patch}.for_each_run([&](size_t offset, std::span<uint8_t const> run) {
+        if (offset > size_in_bytes || run.size() > size_in_bytes - offset)
+            throw std::out_of_range{"XorPatch doesn't fit in its target: a run ends at byte " + std::to_string(offset + run.size()) + " of " + std::to_string(size_in_bytes)};
+    });
+}
+
+inline auto make_xor_patch(std::span<uint8_t const> a, std::span<uint8_t const> b) -> std::vector<uint8_t>
+{
+    auto       writer      = XorPatchWriter{};
+    auto const common_size = std::min(a.size(), b.size());
+    for (size_t i = 0; i < common_size;)
+    {
+        i = static_cast<size_t>(std::mismatch(a.begin() + static_cast<std::ptrdiff_t>(i), a.begin() + static_cast<std::ptrdiff_t>(common_size), b.begin() + static_cast<std::ptrdiff_t>(i)).first - a.begin()); // Skips the bytes that haven't changed, which is usually most of them
+        if (i < common_size)
+        {
+            writer.write(i, static_cast<uint8_t>(a[i] ^ b[i]));
+            i++;
+        }
+    }
+    auto const longest = a.size() > b.size() ? a : b;
+    for (size_t i = common_size; i < longest.size(); ++i)
+        writer.write(i, longest[i]);
+    return std::move(writer).finish();
+}
+
+/// The XOR of two patches, i.e. the patch that applies both of them at once. This is proportional to the size of the patches, not to the size of the buffers.
+inline auto compose_xor_patches(std::span<uint8_t const> patch1, std::span<uint8_t const> patch2) -> std::vector<uint8_t>
+{
+    auto writer = XorPatchWriter{};
+    auto it1    = XorPatchReader{patch1};
+    auto it2    = XorPatchReader{patch2};
+    while (!it1.is_done() || !it2.is_done())
+    {
+        if (it2.is_done() || (!it1.is_done() && it1.offset() < it2.offset()))
+        {
+            writer.write(it1.offset(), it1.byte());
+            it1.next();
+        }
+        else if (it1.is_done() || it2.offset() < it1.offset())
+        {
+            writer.write(it2.offset(), it2.byte());
+            it2.next();
+        }
+        else
+        {
+            writer.write(it1.offset(), static_cast<uint8_t>(it1.byte() ^ it2.byte()));
+            it1.next();
+            it2.next();
+        }
+    }
+    return std::move(writer).finish();
+}
+
+} // namespace internal
+
+/// Stores a compact binary diff between two values of an object, that can be applied in both directions.
+/// Use `execute()` and `revert()` in your Executor, on the object that the command targets.
+/// `merge()` composes two diffs of the same object, and reports that they cancel out if the object ends up unchanged.
+/// NB: the diff doesn't know which object it applies to: if your commands can target several objects, check that they target the same one before merging them.
+template<DeltaCompatibleC T>
+class DeltaCommand {
+public:
+    DeltaCommand(T const& previous_value, T const& new_value)
+        : _patch{internal::make_xor_patch(internal::as_bytes(previous_value), internal::as_bytes(new_value))}
+        , _previous_size_in_bytes{internal::as_bytes(previous_value).size()}
+        , _new_size_in_bytes{internal::as_bytes(new_value).size()}
+    {}
+
+    /// Turns the previous value into the new value.
+    /// Throws std::out_of_range, without modifying the value, if the diff doesn't fit in the value (which can only happen if it has been corrupted before being loaded).
+    void execute(T& value) const { apply(value, _previous_size_in_bytes, _new_size_in_bytes); }
+    /// Turns the new value into the previous value
+    void revert(T& value) const { apply(value, _new_size_in_bytes, _previous_size_in_bytes); }
+
+    /// The commands must be applied one after the other to the same object
+    static auto merge(DeltaCommand const& command1, DeltaCommand const& command2) -> MergeResult<DeltaCommand>
+    {
+        if (command1._new_size_in_bytes != command2._previous_size_in_bytes)
+            return std::nullopt;
+        auto res = DeltaCommand{};
+        res._patch                  = internal::compose_xor_patches(command1._patch, command2._patch);
+        res._previous_size_in_bytes = command1._previous_size_in_bytes;
+        res._new_size_in_bytes      = command2._new_size_in_bytes;
+        if (res.is_identity())
+            return cancel_out;
+        return res;
+    }
+
+    /// True iff the command doesn't change anything
+    auto is_identity() const -> bool { return _patch.empty() && _previous_size_in_bytes == _new_size_in_bytes; }
+
+    /// The number of bytes used to store the diff
+    auto patch_size_in_bytes() const -> size_t { return _patch.size(); }
+
+    /// See HasMemoryFootprintC
+    friend auto memory_footprint(DeltaCommand const& command) -> size_t { return command._patch.capacity(); }
+
+    template<typename Archive>
+    void serialize(Archive& archive)
+    {
+        archive(_patch, _previous_size_in_bytes, _new_size_in_bytes);
+    }
+
+    DeltaCommand() = default; // Only meant for deserialization
+
+private:
+    void apply(T& value, size_t current_size_in_bytes, size_t target_size_in_bytes) const
+    {
+        assert(internal::as_bytes(value).size() == current_size_in_bytes);
+        if constexpr (!internal::is_resizable_container<T>)
+        {
+            if (target_size_in_bytes != sizeof(T))
+                throw std::out_of_range{"DeltaCommand doesn't fit in its target: it has been made for an object of " + std::to_string(target_size_in_bytes) + " bytes"};
+        }
+        internal::check_xor_patch_fits(_patch, std::max(current_size_in_bytes, target_size_in_bytes)); // Before modifying anything
+        internal::resize_bytes(value, std::max(current_size_in_bytes, target_size_in_bytes));
+        auto const bytes = internal::as_writable_bytes(value);
+        internal::XorPatchReader{_patch}.for_each_run([&](size_t offset, std::span<uint8_t const> run) {
+            for (size_t i = 0; i < run.size(); ++i)
+                bytes[offset + i] = static_cast<uint8_t>(bytes[offset + i] ^ run[i]);
+        });
+        internal::resize_bytes(value, target_size_in_bytes);
+    }
+
+private:
+    std::vector<uint8_t> _patch{};
+    size_t               _previous_size_in_bytes{0};
+    size_t               _new_size_in_bytes{0};
+};
+
+/// An Executor for when all your commands are DeltaCommands that target the same object
+template<DeltaCompatibleC T>
+class DeltaExecutor {
+public:
+    explicit DeltaExecutor(T& value)
+        : _value{&value}
+    {}
+
+    void execute(DeltaCommand<T> const& command) { command.execute(*_value); }
+    void revert(DeltaCommand<T> const& command) { command.revert(*_value); }
+
+private:
+    T* _value;
+};
+
+/// A Merger for when all your commands are DeltaCommands that target the same object
+struct DeltaMerger {
+    template<DeltaCompatibleC T>
+    static auto merge(DeltaCommand<T> const& command1, DeltaCommand<T> const& command2) -> MergeResult<DeltaCommand<T>>
+    {
+        return DeltaCommand<T>::merge(command1, command2);
+    }
+};
+
+} // namespace cmd
@@ -3,8 +3,11 @@
 /// An Executor is the user-defined class responsible for executing commands.
 /// This is where they should put (or at least dispatch) all their logic.
 
+#include <concepts>
 #include <memory>
 #include <optional>
+#include <span>
+#include <utility>
 #include "Command.hpp"
 
 namespace cmd {
@@ -14,16 +17,79 @@ concept ExecutorC = requires(ExecutorT executor, CommandT command) {
     executor.execute(command);
 };
 
+/// An Executor can optionally provide a batch hook, that History::replay() will use to execute many commands at once.
+template<typename ExecutorT, typename CommandT>
+concept BatchExecutorC = ExecutorC<ExecutorT, CommandT> && requires(ExecutorT executor, std::span<CommandT const> commands) {
+    executor.execute_batch(commands);
+};
+
 template<typename ReverterT, typename CommandT>
 concept ReverterC = requires(ReverterT reverter, CommandT command) {
     reverter.revert(command);
 };
 
+/// Tag that a Merger can return to tell that two commands cancel each other out, e.g. when a slider has been dragged back to its original value.
+struct CancelOut {};
+inline constexpr CancelOut cancel_out{};
+
+/// What a Merger returns: either the two commands can't be merged (std::nullopt), or they can and this is the resulting command, or they cancel each other out (cmd::cancel_out).
+/// If your commands never cancel out, your Merger can simply return a std::optional<CommandT> instead.
+template<CommandC CommandT>
+class MergeResult {
+public:
+    constexpr MergeResult() = default;
+    constexpr MergeResult(std::nullopt_t) {}                 // NOLINT(*-explicit-constructor, *-explicit-conversions)
+    constexpr MergeResult(CancelOut) : _cancels_out{true} {} // NOLINT(*-explicit-constructor, *-explicit-conversions)
+    constexpr MergeResult(CommandT command)                  // NOLINT(*-explicit-constructor, *-explicit-conversions)
+        : _command{std::move(command)}
+    {}
+    constexpr MergeResult(std::optional<CommandT> command)   // NOLINT(*-explicit-constructor, *-explicit-conversions)
+        : _command{std::move(command)}
+    {}
+
+    /// True if the commands have been merged into a single one, or if they cancel out
+    constexpr auto is_merged() const -> bool { return _command.has_value() || _cancels_out; }
+    constexpr auto cancels_out() const -> bool { return _cancels_out; }
+    constexpr explicit operator bool() const { return is_merged(); }
+
+    /// The resulting command. Only valid if is_merged() and !cancels_out().
+    constexpr auto command() -> CommandT& { return *_command; }
+    constexpr auto command() const -> CommandT const& { return *_command; }
+
+private:
+    std::optional<CommandT> _command{};
+    bool                    _cancels_out{false};
+};
+
 template<typename MergerT, typename CommandT>
 concept MergerC = requires(MergerT merger, CommandT command) {
     // clang-format off
     // clang-format doesn't know about concepts yet and messes up the syntax :-(
-    { merger.merge(command, command) } -> std::convertible_to<std::optional<CommandT>>;
+    requires std::convertible_to<decltype(merger.merge(command, command)), std::optional<CommandT>>
+          || std::convertible_to<decltype(merger.merge(command, command)), MergeResult<CommandT>>;
+    // clang-format on
+};
+
+namespace internal {
+
+/// Calls the merger and converts whatever it returns to a MergeResult
+template<CommandC CommandT, MergerC<CommandT> MergerT>
+constexpr auto merge(MergerT const& merger, CommandT const& command1, CommandT const& command2) -> MergeResult<CommandT>
+{
+    if constexpr (std::convertible_to<decltype(merger.merge(command1, command2)), MergeResult<CommandT>>)
+        return merger.merge(command1, command2);
+    else
+        return std::optional<CommandT>{merger.merge(command1, command2)};
+}
+
+} // namespace internal
+
+/// A merger can optionally tell whether two commands commute, i.e. whether executing them in either order gives the same result.
+/// When it does, History also merges commands that are not next to each other within a group (see History::push()).
+template<typename MergerT, typename CommandT>
+concept CommutativityHintC = MergerC<MergerT, CommandT> && requires(MergerT merger, CommandT command) {
+    // clang-format off
+    { merger.commutes(command, command) } -> std::convertible_to<bool>;
     // clang-format on
 };
 
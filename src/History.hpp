@@ -1,43 +1,111 @@
 #pragma once
+#include <algorithm>
+#include <cassert>
+#include <concepts>
+#include <chrono>
+#include <limits>
+#include <memory>
+#include <memory_resource>
+#include <iterator>
 #include <optional>
+#include <span>
+#include <utility>
 #include <vector>
 #include "Command.hpp"
 #include "Executor.hpp"
+#include "HistoryObserver.hpp"
 #include "internal/CircularBuffer.hpp"
 
 namespace cmd {
 
-template<CommandC CommandT>
+/// Describes how the old commits get folded together by `History::compact_old_commits()`.
+/// The resolution of the history gets coarser with age: the most recent commits are kept as is, and further back in time each commit represents several of the original ones.
+struct CompactionPolicy {
+    size_t recent_commits_count{100};        // The most recent commits are never compacted
+    size_t commits_per_compacted_commit{10}; // Before that, this many adjacent commits are folded into a single one
+};
+
+/// Limits how much work a single call to `History::move_forward_sliced()` / `History::move_backward_sliced()` can do.
+/// At least one command is always processed, so that the transition is guaranteed to make progress.
+struct SliceBudget {
+    std::optional<InstrumentationClock::duration> max_duration{};
+    std::optional<size_t>                          max_commands_count{};
+};
+
+struct TransitionProgress {
+    size_t done_commands_count;
+    size_t commands_count; // Number of commands in the group we are moving through
+    bool   is_moving_forward;
+
+    /// Between 0 and 1
+    auto ratio() const -> float { return static_cast<float>(done_commands_count) / static_cast<float>(commands_count); }
+};
+
+/// Stored alongside each commit, in a separate array so that it doesn't make the commands any bigger
+struct CommitMetadata {
+    InstrumentationClock::time_point creation_time;
+    InstrumentationClock::time_point last_modification_time; // Last time a command has been added to the commit, or merged into it
+    size_t                           byte_size;              // See `History::memory_usage()`
+};
+
+namespace internal {
+
+/// NB: this is O(group.size()) when the commands have a memory footprint, so it should only be used when we have to go through the whole group anyways
+template<typename CommandGroup>
+auto command_group_memory_usage(CommandGroup const& group) -> size_t
+{
+    auto res = sizeof(CommandGroup) + group.capacity() * sizeof(typename CommandGroup::value_type);
+    if constexpr (HasMemoryFootprintC<typename CommandGroup::value_type>)
+    {
+        for (auto const& command : group)
+            res += memory_footprint_of(command);
+    }
+    return res;
+}
+
+} // namespace internal
+
+/// All the memory used by the history is allocated through AllocatorT. See also `cmd::pmr::History`.
+template<CommandC CommandT, HistoryObserverC<CommandT> ObserverT = NoHistoryObserver, typename AllocatorT = std::allocator<CommandT>>
 class History {
 public:
-    using CommandGroup = std::vector<CommandT>;
+    using CommandGroup           = std::vector<CommandT, AllocatorT>;
+    using CommandGroupsAllocator = typename std::allocator_traits<AllocatorT>::template rebind_alloc<CommandGroup>;
+    using CommandGroups          = internal::CircularBuffer<CommandGroup, internal::default_chunk_size, CommandGroupsAllocator>;
+    using CommitsMetadata        = internal::CircularBuffer<CommitMetadata, internal::default_chunk_size, typename std::allocator_traits<AllocatorT>::template rebind_alloc<CommitMetadata>>;
 
-    explicit History(size_t max_size = 1000)
-        : _command_groups{max_size}
+    explicit History(size_t max_size = 1000, ObserverT observer = {}, AllocatorT const& allocator = {})
+        : _command_groups{max_size, CommandGroupsAllocator{allocator}}
+        , _commits_metadata{std::numeric_limits<size_t>::max(), typename CommitsMetadata::allocator_type{allocator}} // We remove the metadata ourselves, at the same time as the commits
+        , _observer{std::move(observer)}
     {}
 
     History(History&&) noexcept            = default;
     History& operator=(History&&) noexcept = default;
 
+    /// O(1): the commits are shared between the two histories until one of them modifies them (see CircularBuffer)
     History clone() const
     {
-        History copy{*this};
-        copy.unsafe_set_next_command_group_to_execute( // To properly "copy" the iterator
-            this->unsafe_get_next_command_group_to_execute()
-        );
-        return copy;
+        return History{*this};
     }
 
     template<typename ExecutorT>
         requires ExecutorC<ExecutorT, CommandT>
     void move_forward(ExecutorT& executor)
     {
-        if (_next_command_group_to_execute
-            && *_next_command_group_to_execute != _command_groups.end())
+        assert(!is_in_transition() && "Finish or cancel the current transition first");
+        if (_next_command_group_to_execute != _command_groups.size())
         {
-            for (auto const& command : **_next_command_group_to_execute)
+            CommandGroup const& group       = _command_groups[_next_command_group_to_execute];
+            auto const          group_begin = internal::now<ObserverT>();
+            for (auto const& command : group)
+            {
+                auto const begin = internal::now<ObserverT>();
                 executor.execute(command); // TODO if one of the commands throws, this can mess up the state. We should probably provide the strong guarantee.
-            (*_next_command_group_to_execute)++;
+                _observer.on_execute(command, begin, internal::now<ObserverT>());
+            }
+            _observer.on_move_forward(group.size(), group_begin, internal::now<ObserverT>());
+            _next_command_group_to_execute++;
         }
         _can_try_to_merge_next_command        = false;
         _should_put_next_command_in_new_group = true;
@@ -47,19 +115,177 @@ public:
         requires ReverterC<ReverterT, CommandT>
     void move_backward(ReverterT& reverter)
     {
-        if (_next_command_group_to_execute
-            && *_next_command_group_to_execute != _command_groups.begin())
+        assert(!is_in_transition() && "Finish or cancel the current transition first");
+        if (_next_command_group_to_execute != 0)
         {
             // We want to undo in the reverse order compared to when we do
-            CommandGroup const& group = *std::prev(*_next_command_group_to_execute);
+            CommandGroup const& group       = _command_groups[_next_command_group_to_execute - 1];
+            auto const          group_begin = internal::now<ObserverT>();
             for (auto it = group.rbegin(); it != group.rend(); ++it)
+            {
+                auto const begin = internal::now<ObserverT>();
                 reverter.revert(*it); // TODO if one of the commands throws, this can mess up the state. We should probably provide the strong guarantee.
-            (*_next_command_group_to_execute)--;
+                _observer.on_revert(*it, begin, internal::now<ObserverT>());
+            }
+            _observer.on_move_backward(group.size(), group_begin, internal::now<ObserverT>());
+            _next_command_group_to_execute--;
         }
         _can_try_to_merge_next_command        = false;
         _should_put_next_command_in_new_group = true;
     }
 
+    /// Like move_forward(), but only executes as many commands of the group as the budget allows, so that a huge group doesn't freeze your application.
+    /// Returns true once the whole group has been executed. Until then the history is in transition: call this again (e.g. once per frame) to resume where it stopped, or call `cancel_transition()`.
+    /// While in transition the history must not be modified (no push, move_forward, set_max_size, etc.), and current_command_group_index() still refers to the commit we started from.
+    template<typename ExecutorT>
+        requires ExecutorC<ExecutorT, CommandT>
+    auto move_forward_sliced(ExecutorT& executor, SliceBudget const& budget) -> bool
+    {
+        return move_sliced(true, budget, [&](CommandT const& command) {
+            auto const begin = internal::now<ObserverT>();
+            executor.execute(command);
+            _observer.on_execute(command, begin, internal::now<ObserverT>());
+        });
+    }
+
+    /// Like move_backward(), but only reverts as many commands of the group as the budget allows. See `move_forward_sliced()`.
+    template<typename ReverterT>
+        requires ReverterC<ReverterT, CommandT>
+    auto move_backward_sliced(ReverterT& reverter, SliceBudget const& budget) -> bool
+    {
+        return move_sliced(false, budget, [&](CommandT const& command) {
+            auto const begin = internal::now<ObserverT>();
+            reverter.revert(command);
+            _observer.on_revert(command, begin, internal::now<ObserverT>());
+        });
+    }
+
+    /// Undoes the part of the transition that has already been done, so that we are back to the commit where the transition started.
+    /// NB: this is not sliced, but it only has to process the commands that have been processed by the transition so far.
+    template<typename ExecutorT>
+        requires ExecutorC<ExecutorT, CommandT> && ReverterC<ExecutorT, CommandT>
+    void cancel_transition(ExecutorT& executor)
+    {
+        if (!_transition)
+            return;
+        auto const& group = transition_group();
+        if (_transition->is_forward)
+        {
+            for (size_t i = _transition->done_commands_count; i-- > 0;)
+            {
+                auto const begin = internal::now<ObserverT>();
+                executor.revert(group[i]);
+                _observer.on_revert(group[i], begin, internal::now<ObserverT>());
+            }
+        }
+        else
+        {
+            for (size_t i = group.size() - _transition->done_commands_count; i < group.size(); ++i)
+            {
+                auto const begin = internal::now<ObserverT>();
+                executor.execute(group[i]);
+                _observer.on_execute(group[i], begin, internal::now<ObserverT>());
+            }
+        }
+        _transition.reset();
+    }
+
+    auto is_in_transition() const -> bool { return _transition.has_value(); }
+
+    /// std::nullopt if we are not in transition
+    auto transition_progress() const -> std::optional<TransitionProgress>
+    {
+        if (!_transition)
+            return std::nullopt;
+        return TransitionProgress{
+            .done_commands_count = _transition->done_commands_count,
+            .commands_count      = transition_group().size(),
+            .is_moving_forward   = _transition->is_forward,
+        };
+    }
+
+    /// Moves forward until the end of the history, like calling move_forward() repeatedly, but much faster for long histories (e.g. when rebuilding a document from its saved history).
+    /// Consecutive commands are merged before being executed, even across groups, so that we execute as few commands as possible.
+    /// If the executor has a batch hook (see BatchExecutorC) the commands are given to it in batches.
+    /// `progress(groups_done_count, groups_count)` is called regularly, and once all the groups have been replayed.
+    template<typename ExecutorT, typename MergerT, typename ProgressCallback = void (*)(size_t, size_t)>
+        requires ExecutorC<ExecutorT, CommandT> && MergerC<MergerT, CommandT>
+    void replay(ExecutorT& executor, const MergerT& merger, ProgressCallback&& progress = [](size_t, size_t) {})
+    {
+        assert(!is_in_transition() && "Finish or cancel the current transition first");
+        constexpr size_t batch_size                = 256;
+        constexpr size_t groups_between_progresses = 1024;
+
+        auto const begin        = internal::now<ObserverT>();
+        auto const first_group  = _next_command_group_to_execute;
+        auto const groups_count = _command_groups.size() - first_group;
+        auto       batch        = std::vector<CommandT>{};
+        size_t     executed_count{0};
+        auto const execute_batch = [&]() {
+            if constexpr (BatchExecutorC<ExecutorT, CommandT>)
+            {
+                auto const batch_begin = internal::now<ObserverT>();
+                executor.execute_batch(std::span<CommandT const>{batch});
+                internal::notify_execute_batch(_observer, std::span<CommandT const>{batch}, batch_begin, internal::now<ObserverT>());
+            }
+            else
+            {
+                for (auto const& command : batch)
+                {
+                    auto const command_begin = internal::now<ObserverT>();
+                    executor.execute(command);
+                    _observer.on_execute(command, command_begin, internal::now<ObserverT>());
+                }
+            }
+            executed_count += batch.size();
+            batch.clear();
+        };
+
+        batch.reserve(batch_size);
+        auto pending = std::optional<CommandT>{}; // The command that we will try to merge the next ones with
+        for (size_t i = first_group; i < _command_groups.size(); ++i)
+        {
+            for (auto const& command : _command_groups[i])
+            {
+                if (!pending)
+                {
+                    pending = command;
+                    continue;
+                }
+                auto merged = internal::merge(merger, *pending, command);
+                if (merged.cancels_out())
+                {
+                    pending.reset();
+                }
+                else if (merged)
+                {
+                    *pending = std::move(merged.command());
+                }
+                else
+                {
+                    batch.push_back(std::move(*pending));
+                    pending = command;
+                    if (batch.size() == batch_size)
+                        execute_batch();
+                }
+            }
+            if ((i - first_group + 1) % groups_between_progresses == 0)
+                progress(i - first_group + 1, groups_count);
+        }
+        if (pending)
+            batch.push_back(std::move(*pending));
+        execute_batch();
+        progress(groups_count, groups_count);
+
+        _observer.on_move_forward(executed_count, begin, internal::now<ObserverT>());
+        _next_command_group_to_execute        = _command_groups.size();
+        _can_try_to_merge_next_command        = false;
+        _should_put_next_command_in_new_group = true;
+    }
+
+    /// If the merger has a commutativity hint (see CommutativityHintC), once a group is closed (i.e. when we push the first command of the next group)
+    /// we also merge the commands of that group that are not next to each other but only have commuting commands in between them.
+    /// For example a group that interleaves edits to two properties ends up with a single command per property.
     template<typename MergerT>
         requires MergerC<MergerT, CommandT>
     void push(const CommandT& command, const MergerT& merger)
@@ -74,6 +300,76 @@ public:
         push_impl(std::move(command), merger);
     }
 
+    /// Same as calling push() for each command, but much cheaper for big batches (e.g. paste, import, scripts):
+    /// the commits in the future are discarded once, the group's capacity is reserved once, and each command then only costs a merge attempt and a push_back.
+    template<typename MergerT>
+        requires MergerC<MergerT, CommandT>
+    void push_batch(std::span<CommandT const> commands, const MergerT& merger)
+    {
+        push_batch_impl(commands.begin(), commands.end(), merger);
+    }
+
+    /// Use std::make_move_iterator() to move the commands into the history instead of copying them.
+    template<std::input_iterator Iterator, std::sentinel_for<Iterator> Sentinel, typename MergerT>
+        requires MergerC<MergerT, CommandT> && std::constructible_from<CommandT, std::iter_reference_t<Iterator>>
+    void push_batch(Iterator first, Sentinel last, const MergerT& merger)
+    {
+        push_batch_impl(std::move(first), std::move(last), merger);
+    }
+
+    /// Folds adjacent old commits together (see CompactionPolicy), using the merger to merge the commands at the boundary of the commits.
+    /// The history then keeps a deeper undo reach for the same max_size, at the cost of a coarser resolution for the old commits.
+    /// This is incremental: it folds at most `max_folds_count` groups of commits.
+    /// The folded commits are then removed from the middle of the history all at once, which moves either the commits that have already been compacted or the ones after the folded ones, whichever are fewer.
+    /// Moving a commit only moves its vector of commands, but the chunks of commits that are shared with a clone get copied (see `clone()`).
+    /// So a call costs O(max_folds_count * commits_per_compacted_commit) merges plus O(min(compacted commits, other commits)) moves, which is cheap enough to run every frame unless the history is really big.
+    /// The observer is notified with `on_compaction(removed_commits_count, begin, end)` if it has it.
+    /// Returns the number of commits that have been removed.
+    /// NB: the commits that have already been compacted are not saved by the serialization, so after loading an history they can be compacted once more.
+    template<typename MergerT>
+        requires MergerC<MergerT, CommandT>
+    auto compact_old_commits(const MergerT& merger, CompactionPolicy const& policy, size_t max_folds_count = 1) -> size_t
+    {
+        assert(!is_in_transition() && "Finish or cancel the current transition first");
+        auto const commits_per_fold = policy.commits_per_compacted_commit;
+        if (commits_per_fold < 2)
+            return 0;
+
+        auto const begin = internal::now<ObserverT>();
+        // We never compact the commits after the current one, nor the last group since more commands might still be added to it
+        auto const end   = std::min(_next_command_group_to_execute, _command_groups.size() - std::min(_command_groups.size(), std::max<size_t>(policy.recent_commits_count, 1)));
+        auto       read  = _compacted_commits_count; // The first commit that hasn't been folded yet
+        auto       write = _compacted_commits_count; // Where the next folded commit goes
+        for (size_t i = 0; i < max_folds_count && read + commits_per_fold <= end; ++i)
+        {
+            if (fold_commits(read, read + commits_per_fold, write, merger))
+                write++;
+            read += commits_per_fold;
+        }
+        if (read == write)
+            return 0;
+
+        _command_groups.erase(write, read); // All the commits that have been folded into the other ones are removed at once
+        erase_metadata(write, read);
+        _next_command_group_to_execute -= read - write; // We only ever fold commits that are before the current one
+        _compacted_commits_count = write;
+        assert(_commits_metadata.size() == _command_groups.size());
+        internal::notify_compaction(_observer, read - write, begin, internal::now<ObserverT>());
+        return read - write;
+    }
+
+    /// When set, instead of evicting the oldest commit when the history is full, push() starts by compacting the old commits (see `compact_old_commits()`).
+    /// We fall back to evicting commits once all the old commits have already been compacted.
+    void set_compaction_policy(std::optional<CompactionPolicy> policy) { _compaction_policy = policy; }
+    auto compaction_policy() const -> std::optional<CompactionPolicy> const& { return _compaction_policy; }
+
+    /// When enabled, the creation and last modification times of the commits are recorded in their metadata (see `commit_metadata()`), which `commit_index_at()` and `move_to_time()` need.
+    /// This is off by default, because it queries the clock on every push.
+    /// NB: the commits that are pushed before it is enabled are considered to have been created at the epoch of the InstrumentationClock.
+    /// The commits that are pushed after it is disabled are considered to have been created at the last time that was recorded, so that the creation times stay sorted.
+    void set_records_commit_times(bool records_commit_times) { _records_commit_times = records_commit_times; }
+    auto records_commit_times() const -> bool { return _records_commit_times; }
+
     /// The history is eager to merge commands: it will try to do it unless you explicitly tell it not to
     void dont_merge_next_command() const { _can_try_to_merge_next_command = false; }
     void start_new_commands_group() { _should_put_next_command_in_new_group = true; }
@@ -88,125 +384,518 @@ public:
     /// NB: this choice was done because it was the simplest to implement, but we could consider adding other policies of which commits to keep.
     void set_max_size(size_t new_max_size)
     {
-        if (_next_command_group_to_execute)
-        {
-            _command_groups.set_max_size_and_preserve_given_iterator(new_max_size, *_next_command_group_to_execute);
-            if (new_max_size == 0)
-            {
-                _next_command_group_to_execute.reset();
-            }
-        }
-        else
-        {
-            _command_groups.set_max_size(new_max_size);
-        }
+        assert(!is_in_transition() && "Finish or cancel the current transition first");
+        auto const index_before  = _next_command_group_to_execute;
+        auto const removed_count = _command_groups.set_max_size_and_preserve_given_index(new_max_size, _next_command_group_to_execute);
+        on_commits_removed(removed_count, index_before - _next_command_group_to_execute);
     }
 
     /// Removes commits until the size of the history is <= max_size
     void shrink(size_t max_size)
     {
-        if (_next_command_group_to_execute)
+        assert(!is_in_transition() && "Finish or cancel the current transition first");
+        auto const index_before  = _next_command_group_to_execute;
+        auto const removed_count = _command_groups.shrink_and_preserve_given_index(max_size, _next_command_group_to_execute);
+        on_commits_removed(removed_count, index_before - _next_command_group_to_execute);
+    }
+
+    /// Removes the oldest commit, i.e. the one furthest away in the past, or if there is none the one furthest away in the future.
+    /// Returns an estimation of the number of bytes that have been freed (see `memory_usage()`), or 0 if nothing was removed.
+    /// NB: while in transition (see `move_forward_sliced()`), the commit we are moving through is never removed.
+    auto evict_oldest_commit() -> size_t
+    {
+        auto const protected_index = _transition ? std::optional{transition_group_index()} : std::nullopt;
+        if (_command_groups.is_empty()
+            || (_command_groups.size() == 1 && protected_index))
         {
-            _command_groups.shrink_and_preserve_given_iterator(max_size, *_next_command_group_to_execute);
-            if (max_size == 0)
-            {
-                _next_command_group_to_execute.reset();
-            }
+            return 0;
+        }
+        auto const evict_in_the_past = _next_command_group_to_execute != 0 && protected_index != 0;
+        auto const freed_bytes       = _commits_metadata[evict_in_the_past ? 0 : _commits_metadata.size() - 1].byte_size;
+        if (evict_in_the_past)
+        {
+            _command_groups.pop_front();
+            _next_command_group_to_execute--;
         }
         else
         {
-            // No need to do anything since _commands is already empty
-            assert(_command_groups.is_empty());
+            _command_groups.pop_back();
         }
+        on_commits_removed(1, evict_in_the_past ? 1 : 0);
+        return freed_bytes;
+    }
+
+    /// Number of bytes used by the commits: their commands, the vectors that store them, and the memory that the commands own themselves if they have a memory_footprint() (see HasMemoryFootprintC).
+    /// NB: this is O(1), the total is kept up to date as the commits change.
+    auto memory_usage() const -> size_t { return _memory_usage; }
+
+    /// NB: there is no non-const overload anymore, because the commits must only be modified through the History, which keeps their metadata and memory_usage() in sync with them.
+    auto underlying_container() const -> CommandGroups const& { return _command_groups; }
+
+    /// Index in underlying_container() of the group that will be executed by the next call to move_forward(). Equal to size() if there is none.
+    auto current_command_group_index() const -> size_t { return _next_command_group_to_execute; }
+
+    /// Iterator in underlying_container() to the group that will be executed by the next call to move_forward(). Equal to underlying_container().end() if there is none.
+    [[deprecated("Use current_command_group_index() instead")]] auto current_command_group_iterator() const -> typename CommandGroups::const_iterator
+    {
+        return _command_groups.begin() + static_cast<std::ptrdiff_t>(_next_command_group_to_execute);
+    }
+
+    /// The metadata of the commit at the given index in underlying_container()
+    auto commit_metadata(size_t index) const -> CommitMetadata const& { return _commits_metadata[index]; }
+
+    /// The value that current_command_group_index() would need to have for the history to be in the state it was at the given time,
+    /// i.e. the number of commits that had been created by then. O(log(size())).
+    /// NB: commands that got merged into a commit after that time are still part of the commit.
+    /// NB: the history must record the commit times, see `set_records_commit_times()`.
+    auto commit_index_at(InstrumentationClock::time_point time) const -> size_t
+    {
+        assert(_records_commit_times && "Call set_records_commit_times(true) first");
+        auto const it = std::partition_point(_commits_metadata.begin(), _commits_metadata.end(), [&](CommitMetadata const& metadata) {
+            return metadata.creation_time <= time;
+        });
+        return static_cast<size_t>(it - _commits_metadata.begin());
+    }
+
+    /// Moves backward or forward until current_command_group_index() == index
+    template<typename ExecutorT>
+        requires ExecutorC<ExecutorT, CommandT> && ReverterC<ExecutorT, CommandT>
+    void move_to(size_t index, ExecutorT& executor)
+    {
+        assert(index <= size());
+        while (_next_command_group_to_execute > index)
+            move_backward(executor);
+        while (_next_command_group_to_execute < index)
+            move_forward(executor);
+    }
+
+    /// Goes back (or forward) to how things were at the given time, e.g. `history.move_to_time(InstrumentationClock::now() - std::chrono::minutes{5}, executor)`.
+    template<typename ExecutorT>
+        requires ExecutorC<ExecutorT, CommandT> && ReverterC<ExecutorT, CommandT>
+    void move_to_time(InstrumentationClock::time_point time, ExecutorT& executor)
+    {
+        move_to(commit_index_at(time), executor);
     }
 
-    auto underlying_container() const -> std::list<CommandGroup> const& { return _command_groups.underlying_container(); }
-    auto underlying_container() -> std::list<CommandGroup>& { return _command_groups.underlying_container(); }
+    auto observer() const -> ObserverT const& { return _observer; }
+    auto observer() -> ObserverT& { return _observer; }
 
-    auto current_command_group_iterator() const { return _next_command_group_to_execute; }
+    auto get_allocator() const -> AllocatorT { return AllocatorT{_command_groups.get_allocator()}; }
 
     // Exposed for serialization purposes. Don't use this unless you have a really good reason to.
     void unsafe_set_next_command_group_to_execute(std::optional<size_t> index)
     {
-        if (index)
-        {
-            _next_command_group_to_execute = _command_groups.begin();
-            for (size_t i = 0; i < *index; ++i)
-            {
-                (*_next_command_group_to_execute)++;
-            }
-        }
-        else
-        {
-            _next_command_group_to_execute.reset();
-        }
+        assert(index.value_or(0) <= _command_groups.size());
+        _next_command_group_to_execute = index.value_or(0);
     }
 
     // Exposed for serialization purposes. Don't use this unless you have a really good reason to.
     auto unsafe_get_next_command_group_to_execute() const -> std::optional<size_t>
     {
-        if (_next_command_group_to_execute)
-        {
-            size_t dist{0};
-            for (auto it = _command_groups.begin(); it != *_next_command_group_to_execute; ++it)
-            {
-                ++dist;
-            }
-            return dist;
-        }
-        else
-        {
+        if (_command_groups.is_empty())
             return std::nullopt;
+        return _next_command_group_to_execute;
+    }
+
+    // Exposed for serialization purposes. Don't use this unless you have a really good reason to.
+    // Replaces all the commits of the history. You then need to call unsafe_set_next_command_group_to_execute().
+    void unsafe_set_command_groups(std::vector<CommandGroup> command_groups)
+    {
+        _command_groups = CommandGroups{std::max(_command_groups.max_size(), command_groups.size()), _command_groups.get_allocator()};
+        _commits_metadata.clear();
+        _memory_usage  = 0;
+        auto const now = commit_time(); // We don't know when the commits have been created, so we consider that they are all brand new
+        for (auto& group : command_groups)
+        {
+            auto const byte_size = internal::command_group_memory_usage(group);
+            _commits_metadata.push_back(CommitMetadata{.creation_time = now, .last_modification_time = now, .byte_size = byte_size});
+            _command_groups.push_back(std::move(group));
+            _memory_usage += byte_size;
         }
+        _next_command_group_to_execute       = _command_groups.size();
+        _compacted_commits_count             = 0;
+        _should_merge_commands_of_last_group = false;
     }
 
 private:
     template<typename CommandType, typename MergerType> // CommandType instead of CommandT to not override CommandT which is already the template parameter of the whole class; CommandT and CommandType need to be different otherwise perfect forwarding won't kick in
     void push_impl(CommandType&& command, const MergerType& merger)
     {
+        assert(!is_in_transition() && "Finish or cancel the current transition first");
         if (_command_groups.max_size() == 0) // Avoids a crash later on in push_the_command(), where we assume that doing a push_back() on _commands_group guarantees it won't be empty.
             return;
 
+        _observer.on_push(command, internal::now<ObserverT>());
+
         auto const push_the_command = [&]() {
             if (_should_put_next_command_in_new_group
                 || _command_groups.is_empty())
             {
-                _command_groups.push_back(CommandGroup{});
+                if constexpr (CommutativityHintC<MergerType, CommandT>)
+                {
+                    if (_should_merge_commands_of_last_group && !_command_groups.is_empty())
+                    {
+                        merge_commuting_commands(_command_groups.back(), merger);
+                        if (_command_groups.back().empty()) // All its commands cancelled out
+                        {
+                            _command_groups.pop_back();
+                            erase_metadata_starting_at(_command_groups.size());
+                        }
+                        else
+                        {
+                            set_byte_size(_commits_metadata.back(), internal::command_group_memory_usage(_command_groups.back()));
+                        }
+                    }
+                }
+                _should_merge_commands_of_last_group = true;
+                if (_compaction_policy && _command_groups.size() == _command_groups.max_size())
+                    compact_old_commits(merger, *_compaction_policy);
+                auto const evicted_count = _command_groups.push_back(CommandGroup{get_allocator()});
+                on_commits_removed_at_the_front(evicted_count);
+                auto const now = commit_time();
+                _commits_metadata.push_back(CommitMetadata{.creation_time = now, .last_modification_time = now, .byte_size = 0});
+                set_byte_size(_commits_metadata.back(), internal::command_group_memory_usage(_command_groups.back()));
+                notify_eviction(evicted_count);
+                _observer.on_new_group(internal::now<ObserverT>());
+            }
+            else if (!_can_try_to_merge_next_command)
+            {
+                _should_merge_commands_of_last_group = false; // The user explicitly asked not to merge this command with the previous ones
             }
             _should_put_next_command_in_new_group = false;
-            _command_groups.back().push_back(std::forward<CommandType>(command));
+            auto&      last_group      = _command_groups.back();
+            auto const capacity_before = last_group.capacity();
+            last_group.push_back(std::forward<CommandType>(command));
+            on_last_commit_modified(capacity_before, internal::memory_footprint_of(last_group.back()), 0);
         };
 
-        if (_next_command_group_to_execute)
+        if (_next_command_group_to_execute < _command_groups.size())
         {
-            _command_groups.erase_all_starting_at(*_next_command_group_to_execute);
+            _command_groups.erase_all_starting_at(_next_command_group_to_execute);
+            erase_metadata_starting_at(_next_command_group_to_execute);
+            _compacted_commits_count             = std::min(_compacted_commits_count, _command_groups.size());
+            _should_merge_commands_of_last_group = false; // The new last group has already been closed before
         }
         if (!_command_groups.is_empty()
             && _can_try_to_merge_next_command)
         {
-            auto&      last_command = _command_groups.back().back(); // The second back() is safe because we should never have empty command groups.
-            auto const merged       = merger.merge(last_command, command);
+            auto& last_group = _command_groups.back();
+            auto  merged     = internal::merge(merger, last_group.back(), command); // back() is safe because we should never have empty command groups.
+            _observer.on_merge(merged.is_merged(), internal::now<ObserverT>());
+            if (merged.cancels_out())
+            {
+                remove_last_command();
+                return;
+            }
             if (merged)
-                last_command = *merged;
+            {
+                auto const footprint_before = internal::memory_footprint_of(last_group.back());
+                last_group.back()           = std::move(merged.command());
+                on_last_commit_modified(last_group.capacity(), internal::memory_footprint_of(last_group.back()), footprint_before);
+            }
             else
+            {
                 push_the_command();
+            }
         }
         else
         {
             push_the_command();
         }
-        _next_command_group_to_execute = _command_groups.end();
+        _next_command_group_to_execute = _command_groups.size();
         _can_try_to_merge_next_command = true;
+        assert(_commits_metadata.size() == _command_groups.size());
+    }
+
+    template<typename ApplyCommand>
+    auto move_sliced(bool is_forward, SliceBudget const& budget, ApplyCommand&& apply_command) -> bool
+    {
+        _can_try_to_merge_next_command        = false;
+        _should_put_next_command_in_new_group = true;
+        if (!_transition)
+        {
+            if (_next_command_group_to_execute == (is_forward ? _command_groups.size() : 0))
+                return true;
+            _transition = Transition{.is_forward = is_forward, .begin = internal::now<ObserverT>(), .done_commands_count = 0};
+        }
+        assert(_transition->is_forward == is_forward && "Finish or cancel the current transition before starting one in the other direction");
+
+        auto const& group                  = transition_group();
+        auto const  slice_begin            = budget.max_duration ? InstrumentationClock::now() : InstrumentationClock::time_point{};
+        size_t      commands_in_this_slice = 0;
+        while (_transition->done_commands_count < group.size())
+        {
+            if (commands_in_this_slice != 0
+                && ((budget.max_commands_count && commands_in_this_slice >= *budget.max_commands_count)
+                    || (budget.max_duration && InstrumentationClock::now() - slice_begin >= *budget.max_duration)))
+            {
+                return false;
+            }
+            // We want to undo in the reverse order compared to when we do
+            apply_command(is_forward ? group[_transition->done_commands_count] : group[group.size() - 1 - _transition->done_commands_count]);
+            _transition->done_commands_count++;
+            commands_in_this_slice++;
+        }
+
+        if (is_forward)
+        {
+            _observer.on_move_forward(group.size(), _transition->begin, internal::now<ObserverT>());
+            _next_command_group_to_execute++;
+        }
+        else
+        {
+            _observer.on_move_backward(group.size(), _transition->begin, internal::now<ObserverT>());
+            _next_command_group_to_execute--;
+        }
+        _transition.reset();
+        return true;
+    }
+
+    auto transition_group_index() const -> size_t
+    {
+        return _transition->is_forward ? _next_command_group_to_execute : _next_command_group_to_execute - 1;
+    }
+
+    auto transition_group() const -> CommandGroup const& { return _command_groups[transition_group_index()]; }
+
+    template<typename Iterator, typename Sentinel, typename MergerType>
+    void push_batch_impl(Iterator first, Sentinel last, const MergerType& merger)
+    {
+        while (first != last)
+        {
+            // The first command goes through the regular push, which takes care of the commits in the future, of creating a new group, of evictions, etc.
+            push_impl(*first, merger);
+            ++first;
+            if (_command_groups.max_size() == 0) // Nothing can ever be pushed
+                return;
+            if (!_can_try_to_merge_next_command || _should_put_next_command_in_new_group) // e.g. the command cancelled out: the next one must go through the regular push too, that will know if it has to go in a new group
+                continue;
+            // Then, as long as nothing cancels out, all the commands go into the same group
+            auto&      group             = _command_groups.back();
+            auto const capacity_before   = group.capacity();
+            size_t     added_footprint   = 0;
+            size_t     removed_footprint = 0;
+            if constexpr (std::sized_sentinel_for<Sentinel, Iterator>)
+                group.reserve(group.size() + static_cast<size_t>(last - first));
+            bool has_cancelled_out = false;
+            for (; first != last && !has_cancelled_out; ++first)
+            {
+                _observer.on_push(*first, internal::now<ObserverT>());
+                auto merged = internal::merge(merger, group.back(), *first);
+                _observer.on_merge(merged.is_merged(), internal::now<ObserverT>());
+                if (merged.cancels_out())
+                {
+                    has_cancelled_out = true;
+                }
+                else if (merged)
+                {
+                    removed_footprint += internal::memory_footprint_of(group.back());
+                    group.back() = std::move(merged.command());
+                    added_footprint += internal::memory_footprint_of(group.back());
+                }
+                else
+                {
+                    group.push_back(*first);
+                    added_footprint += internal::memory_footprint_of(group.back());
+                }
+            }
+            on_last_commit_modified(capacity_before, added_footprint, removed_footprint);
+            if (has_cancelled_out)
+                remove_last_command(); // Might remove the group, so we need to go through the regular push again for the next command
+        }
+    }
+
+    /// The last command and the one we were pushing cancel out, so we get rid of both of them (and of the last group if it becomes empty)
+    void remove_last_command()
+    {
+        auto&      last_group = _command_groups.back();
+        auto const footprint  = internal::memory_footprint_of(last_group.back());
+        last_group.pop_back();
+        if (last_group.empty())
+        {
+            _command_groups.pop_back();
+            erase_metadata_starting_at(_command_groups.size());
+            _compacted_commits_count              = std::min(_compacted_commits_count, _command_groups.size());
+            _should_merge_commands_of_last_group  = false; // The new last group has already been closed before
+            _should_put_next_command_in_new_group = true;
+        }
+        else
+        {
+            on_last_commit_modified(last_group.capacity(), 0, footprint);
+        }
+        _next_command_group_to_execute = _command_groups.size();
+        _can_try_to_merge_next_command = false; // We don't know if the command that is now the last one could be merged with the one that was before it
+    }
+
+    /// Commands have been added to the last commit, merged into it or removed from it. This doesn't go through all the commands of the commit, so that pushing stays O(1).
+    void on_last_commit_modified(size_t capacity_before, size_t added_footprint, size_t removed_footprint)
+    {
+        auto&      metadata             = _commits_metadata.back();
+        auto const capacity_after       = _command_groups.back().capacity(); // The capacity of a vector never decreases unless we explicitly ask for it
+        metadata.last_modification_time = commit_time();
+        set_byte_size(metadata, metadata.byte_size + (capacity_after - capacity_before) * sizeof(CommandT) + added_footprint - removed_footprint);
+    }
+
+    /// Never goes back in time, even when the recording gets disabled: `commit_index_at()` relies on the creation times being sorted.
+    auto commit_time() const -> InstrumentationClock::time_point
+    {
+        if (_records_commit_times)
+            return InstrumentationClock::now();
+        return _commits_metadata.is_empty() ? InstrumentationClock::time_point{} : _commits_metadata.back().last_modification_time; // The latest time that has been recorded
+    }
+
+    void set_byte_size(CommitMetadata& metadata, size_t byte_size)
+    {
+        _memory_usage      = _memory_usage - metadata.byte_size + byte_size;
+        metadata.byte_size = byte_size;
+    }
+
+    void erase_metadata(size_t first, size_t last)
+    {
+        for (size_t i = first; i < last; ++i)
+            _memory_usage -= _commits_metadata[i].byte_size;
+        _commits_metadata.erase(first, last);
+    }
+
+    void erase_metadata_starting_at(size_t index)
+    {
+        if (index < _commits_metadata.size())
+            erase_metadata(index, _commits_metadata.size());
+    }
+
+    /// Merges each command with the latest command before it that it can be merged with, as long as all the commands in between commute with it.
+    /// Commands that cancel out are removed, so the group might end up empty.
+    template<typename MergerType>
+    static void merge_commuting_commands(CommandGroup& group, const MergerType& merger)
+    {
+        if (group.size() < 3) // Two commands next to each other have already been tried when they were pushed
+            return;
+        size_t kept_count = 1;
+        for (size_t i = 1; i < group.size(); ++i)
+        {
+            bool has_been_merged = false;
+            for (size_t j = kept_count; j-- > 0;)
+            {
+                auto merged = internal::merge(merger, group[j], group[i]);
+                if (merged.cancels_out())
+                {
+                    std::move(group.begin() + static_cast<std::ptrdiff_t>(j + 1), group.begin() + static_cast<std::ptrdiff_t>(kept_count), group.begin() + static_cast<std::ptrdiff_t>(j));
+                    kept_count--;
+                    has_been_merged = true;
+                    break;
+                }
+                if (merged)
+                {
+                    group[j]        = std::move(merged.command());
+                    has_been_merged = true;
+                    break;
+                }
+                if (!merger.commutes(group[j], group[i]))
+                    break;
+            }
+            if (!has_been_merged)
+            {
+                if (kept_count != i)
+                    group[kept_count] = std::move(group[i]);
+                kept_count++;
+            }
+        }
+        group.erase(group.begin() + static_cast<std::ptrdiff_t>(kept_count), group.end());
+    }
+
+    /// Merges all the commits in [first, last) into the first one, then swaps it with the commit at `destination` (<= first).
+    /// The commits that are left empty are not removed, it is up to the caller to remove them all at once.
+    /// Returns false if all the commands cancelled out, in which case nothing is swapped.
+    template<typename MergerType>
+    auto fold_commits(size_t first, size_t last, size_t destination, const MergerType& merger) -> bool
+    {
+        auto& folded_group = _command_groups.mutable_at(first);
+        for (size_t i = first + 1; i < last; ++i)
+        {
+            for (auto& command : _command_groups.mutable_at(i))
+            {
+                if (folded_group.empty())
+                {
+                    folded_group.push_back(std::move(command));
+                    continue;
+                }
+                auto merged = internal::merge(merger, folded_group.back(), command);
+                if (merged.cancels_out())
+                    folded_group.pop_back();
+                else if (merged)
+                    folded_group.back() = std::move(merged.command());
+                else
+                    folded_group.push_back(std::move(command));
+            }
+        }
+        if (folded_group.empty())
+            return false;
+        auto& metadata                  = _commits_metadata.mutable_at(first);
+        metadata.last_modification_time = _commits_metadata[last - 1].last_modification_time;
+        set_byte_size(metadata, internal::command_group_memory_usage(folded_group));
+        if (destination != first) // Swapping keeps _memory_usage in sync, since each byte_size stays with its commit
+        {
+            std::swap(folded_group, _command_groups.mutable_at(destination));
+            std::swap(metadata, _commits_metadata.mutable_at(destination));
+        }
+        return true;
+    }
+
+    void on_commits_removed_at_the_front(size_t removed_commits_count)
+    {
+        erase_metadata(0, removed_commits_count);
+        _compacted_commits_count -= std::min(_compacted_commits_count, removed_commits_count);
+    }
+
+    void on_commits_removed(size_t removed_commits_count, size_t removed_at_the_front_count)
+    {
+        on_commits_removed_at_the_front(removed_at_the_front_count);
+        erase_metadata_starting_at(_command_groups.size());
+        assert(_commits_metadata.size() == _command_groups.size());
+        if (removed_commits_count != removed_at_the_front_count)
+            _should_merge_commands_of_last_group = false; // The last group has changed
+        notify_eviction(removed_commits_count);
+    }
+
+    void notify_eviction(size_t evicted_commits_count)
+    {
+        if (evicted_commits_count != 0)
+            _observer.on_eviction(evicted_commits_count, internal::now<ObserverT>());
     }
 
     History(const History&)            = default; // Use `clone()` instead
     History& operator=(const History&) = default; // if you really want a copy of your history
 
 private:
-    internal::CircularBuffer<CommandGroup>                                   _command_groups;
-    std::optional<typename internal::CircularBuffer<CommandGroup>::iterator> _next_command_group_to_execute{};
-    mutable bool                                                             _can_try_to_merge_next_command{false};
-    bool                                                                     _should_put_next_command_in_new_group{true};
+    struct Transition {
+        bool                             is_forward;
+        InstrumentationClock::time_point begin;
+        size_t                           done_commands_count;
+    };
+
+private:
+    CommandGroups                   _command_groups;
+    CommitsMetadata                 _commits_metadata; // One per commit, always in sync with _command_groups
+    size_t                          _memory_usage{0}; // Sum of the byte_size of all the commits
+    size_t                          _next_command_group_to_execute{0};
+    mutable bool                    _can_try_to_merge_next_command{false};
+    bool                            _should_put_next_command_in_new_group{true};
+    bool                            _should_merge_commands_of_last_group{false}; // Set to false once the last group is closed, or if it contains commands that must not be merged
+    size_t                          _compacted_commits_count{0}; // The commits in [0, _compacted_commits_count) are the result of a compaction, and must not be compacted again
+    std::optional<CompactionPolicy> _compaction_policy{};
+    bool                            _records_commit_times{false};
+    std::optional<Transition>       _transition{}; // Set while a move_forward_sliced() or move_backward_sliced() is in progress
+    CMD_NO_UNIQUE_ADDRESS ObserverT _observer;
 };
 
+namespace pmr {
+
+/// An History whose memory is allocated through a std::pmr::memory_resource.
+/// For example you can use one std::pmr::monotonic_buffer_resource per document, or a std::pmr::unsynchronized_pool_resource shared by many documents.
+/// NB: the memory resource must outlive the history.
+template<CommandC CommandT, HistoryObserverC<CommandT> ObserverT = NoHistoryObserver>
+using History = cmd::History<CommandT, ObserverT, std::pmr::polymorphic_allocator<CommandT>>;
+
+} // namespace pmr
+
 } // namespace cmd
\ No newline at end of file
@@ -0,0 +1,272 @@
+#pragma once
+
+/// A HistoryManager owns the histories of all the documents (or layers, etc.) that are open in an application, and makes sure that together they stay below one global memory budget.
+/// When the budget is exceeded, commits get evicted across all the histories, following an EvictionPolicy.
+/// It also gathers memory and latency statistics for all the histories at once.
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <optional>
+#include <utility>
+#include <vector>
+#include "HistoryObserver.hpp"
+
+namespace cmd {
+
+/// History, HistoryWithUi, HistoryWithSerialization and HistoryWithUiAndSerialization can all be managed by a HistoryManager
+template<typename HistoryT>
+concept ManageableHistoryC = requires(HistoryT history, HistoryT const const_history) {
+    { history.evict_oldest_commit() } -> std::convertible_to<size_t>;
+    { const_history.memory_usage() } -> std::convertible_to<size_t>;
+    { const_history.size() } -> std::convertible_to<size_t>;
+};
+
+enum class EvictionPolicy {
+    LeastRecentlyFocusedFirst, // Evicts from the histories of the documents that the user hasn't touched in a long time first
+    LargestFirst,              // Evicts from the history that uses the most memory first
+};
+
+/// Latency of one kind of operation, measured across all the histories of a HistoryManager
+struct LatencyStats {
+    size_t                         count{0};
+    InstrumentationClock::duration total{};
+    InstrumentationClock::duration max{};
+
+    auto average() const -> InstrumentationClock::duration
+    {
+        return count == 0
+                   ? InstrumentationClock::duration{}
+                   : total / static_cast<InstrumentationClock::duration::rep>(count);
+    }
+
+    void add(InstrumentationClock::duration duration)
+    {
+        count++;
+        total += duration;
+        max = std::max(max, duration);
+    }
+};
+
+struct HistoryManagerStats {
+    size_t       histories_count{0};
+    size_t       commits_count{0};
+    size_t       memory_usage{0};          // In bytes, see `History::memory_usage()`
+    size_t       memory_budget{0};         // In bytes
+    size_t       evicted_commits_count{0}; // Only counts the evictions caused by the memory budget, not the ones caused by the max_size of each history
+    LatencyStats push{};
+    LatencyStats move_forward{};
+    LatencyStats move_backward{};
+};
+
+template<ManageableHistoryC HistoryT>
+class HistoryManager {
+public:
+    using HistoryId = uint64_t;
+
+    explicit HistoryManager(size_t memory_budget_in_bytes, EvictionPolicy policy = EvictionPolicy::LeastRecentlyFocusedFirst)
+        : _memory_budget{memory_budget_in_bytes}
+        , _policy{policy}
+    {}
+
+    /// The arguments are forwarded to the constructor of HistoryT. The new history gets the focus.
+    template<typename... Args>
+    auto create_history(Args&&... args) -> HistoryId
+    {
+        auto const id = _next_id++;
+        _entries.push_back(Entry{
+            .id                   = id,
+            .history              = HistoryT(std::forward<Args>(args)...),
+            .memory_usage         = 0,
+            .last_focus_timestamp = 0,
+        });
+        focus(id);
+        update_memory_usage(_entries.back());
+        enforce_memory_budget();
+        return id;
+    }
+
+    void remove_history(HistoryId id)
+    {
+        auto const it = find(id);
+        _memory_usage -= it->memory_usage;
+        _entries.erase(it);
+        if (_focused == id)
+            _focused.reset();
+    }
+
+    auto contains(HistoryId id) const -> bool
+    {
+        return std::ranges::any_of(_entries, [&](Entry const& entry) { return entry.id == id; });
+    }
+
+    /// NB: if you modify the history directly, call `on_history_modified()` afterwards so that the memory budget can be enforced
+    /// The reference stays valid until the history is removed, no matter how many histories are created in the meantime.
+    auto history(HistoryId id) -> HistoryT& { return find(id)->history; }
+    auto history(HistoryId id) const -> HistoryT const& { return find(id)->history; }
+
+    /// Tells the manager that the user is now working on this history. It will be the last one to get evicted with EvictionPolicy::LeastRecentlyFocusedFirst.
+    void focus(HistoryId id)
+    {
+        find(id)->last_focus_timestamp = ++_focus_timestamp;
+        _focused                       = id;
+    }
+    auto focused() const -> std::optional<HistoryId> { return _focused; }
+
+    template<typename CommandT, typename MergerT>
+    void push(HistoryId id, CommandT&& command, MergerT const& merger)
+    {
+        auto& entry = *find(id);
+        measure(_stats.push, [&]() { entry.history.push(std::forward<CommandT>(command), merger); });
+        on_history_modified(entry);
+    }
+
+    template<typename ExecutorT>
+    void move_forward(HistoryId id, ExecutorT& executor)
+    {
+        auto& entry = *find(id);
+        measure(_stats.move_forward, [&]() { entry.history.move_forward(executor); });
+        on_history_modified(entry);
+    }
+
+    template<typename ReverterT>
+    void move_backward(HistoryId id, ReverterT& reverter)
+    {
+        auto& entry = *find(id);
+        measure(_stats.move_backward, [&]() { entry.history.move_backward(reverter); });
+        on_history_modified(entry);
+    }
+
+    void on_history_modified(HistoryId id) { on_history_modified(*find(id)); }
+
+    /// Evicts commits right away if the new budget is smaller than the current memory usage
+    void set_memory_budget(size_t memory_budget_in_bytes)
+    {
+        _memory_budget = memory_budget_in_bytes;
+        enforce_memory_budget();
+    }
+    auto memory_budget() const -> size_t { return _memory_budget; }
+
+    void set_eviction_policy(EvictionPolicy policy) { _policy = policy; }
+    auto eviction_policy() const -> EvictionPolicy { return _policy; }
+
+    /// Sum of the memory used by all the histories, in bytes. O(1).
+    auto memory_usage() const -> size_t { return _memory_usage; }
+
+    auto histories_count() const -> size_t { return _entries.size(); }
+
+    /// O(number of histories)
+    auto stats() const -> HistoryManagerStats
+    {
+        auto res            = _stats;
+        res.histories_count = _entries.size();
+        res.memory_usage    = _memory_usage;
+        res.memory_budget   = _memory_budget;
+        for (auto const& entry : _entries)
+            res.commits_count += entry.history.size();
+        return res;
+    }
+
+    void reset_stats() { _stats = HistoryManagerStats{}; }
+
+    /// Evicts commits until the memory usage is below the budget, or until all the histories are empty.
+    /// This is called automatically after each operation that goes through the manager.
+    void enforce_memory_budget()
+    {
+        auto histories_that_cant_evict = std::vector<HistoryId>{}; // e.g. because their only commit is in the middle of a sliced undo. We will try again after the next operation.
+        while (_memory_usage > _memory_budget)
+        {
+            auto* const entry = next_entry_to_evict_from(histories_that_cant_evict);
+            if (!entry)
+                return;
+            auto const size_before = entry->history.size();
+            entry->history.evict_oldest_commit();
+            if (entry->history.size() == size_before)
+            {
+                histories_that_cant_evict.push_back(entry->id);
+                continue;
+            }
+            update_memory_usage(*entry);
+            _stats.evicted_commits_count++;
+        }
+    }
+
+private:
+    struct Entry {
+        HistoryId id;
+        HistoryT  history;
+        size_t    memory_usage;
+        uint64_t  last_focus_timestamp;
+    };
+
+    auto find(HistoryId id) -> typename std::list<Entry>::iterator
+    {
+        auto const it = std::ranges::find(_entries, id, &Entry::id);
+        assert(it != _entries.end() && "This history doesn't exist, or has been removed");
+        return it;
+    }
+
+    auto find(HistoryId id) const -> typename std::list<Entry>::const_iterator
+    {
+        auto const it = std::ranges::find(_entries, id, &Entry::id);
+        assert(it != _entries.end() && "This history doesn't exist, or has been removed");
+        return it;
+    }
+
+    void on_history_modified(Entry& entry)
+    {
+        update_memory_usage(entry);
+        enforce_memory_budget();
+    }
+
+    void update_memory_usage(Entry& entry)
+    {
+        auto const new_memory_usage = static_cast<size_t>(entry.history.memory_usage());
+        _memory_usage               = _memory_usage - entry.memory_usage + new_memory_usage;
+        entry.memory_usage          = new_memory_usage;
+    }
+
+    auto next_entry_to_evict_from(std::vector<HistoryId> const& ids_to_skip) -> Entry*
+    {
+        Entry* res = nullptr;
+        for (auto& entry : _entries)
+        {
+            if (entry.history.size() == 0
+                || std::ranges::find(ids_to_skip, entry.id) != ids_to_skip.end())
+            {
+                continue;
+            }
+            if (!res
+                || (_policy == EvictionPolicy::LeastRecentlyFocusedFirst && entry.last_focus_timestamp < res->last_focus_timestamp)
+                || (_policy == EvictionPolicy::LargestFirst && entry.memory_usage > res->memory_usage))
+            {
+                res = &entry;
+            }
+        }
+        return res;
+    }
+
+    template<typename Callback>
+    static void measure(LatencyStats& stats, Callback&& callback)
+    {
+        auto const begin = InstrumentationClock::now();
+        callback();
+        stats.add(InstrumentationClock::now() - begin);
+    }
+
+private:
+    std::list<Entry>         _entries{}; // Not a vector, so that the references returned by history() are not invalidated when we create new histories
+    size_t                   _memory_budget;
+    size_t                   _memory_usage{0};
+    EvictionPolicy           _policy;
+    HistoryManagerStats      _stats{};
+    HistoryId                _next_id{0};
+    uint64_t                 _focus_timestamp{0};
+    std::optional<HistoryId> _focused{};
+};
+
+} // namespace cmd
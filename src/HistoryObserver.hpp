@@ -0,0 +1,191 @@
+#pragma once
+
+/// A HistoryObserver is notified of everything that happens inside an History (push, merge, eviction, execution, etc.).
+/// This is meant for instrumentation: profiling, statistics, tracing, and so on.
+/// By default an History uses NoHistoryObserver, in which case all the instrumentation compiles to nothing.
+
+#include <chrono>
+#include <cstddef>
+#include <span>
+#include <type_traits>
+#include "Command.hpp"
+
+#if defined(_MSC_VER)
+#define CMD_NO_UNIQUE_ADDRESS [[msvc::no_unique_address]]
+#else
+#define CMD_NO_UNIQUE_ADDRESS [[no_unique_address]]
+#endif
+
+namespace cmd {
+
+using InstrumentationClock = std::chrono::steady_clock;
+
+template<typename ObserverT, typename CommandT>
+concept HistoryObserverC = requires(ObserverT observer, CommandT command, InstrumentationClock::time_point time, bool merged, size_t count) {
+    observer.on_push(command, time);              // Called before trying to merge the command or to add it to the history
+    observer.on_merge(merged, time);              // Called every time we try to merge a command, `merged` tells you if it was a hit or a miss
+    observer.on_new_group(time);                  // Called when a new commands group is created
+    observer.on_eviction(count, time);            // Called when `count` commits have been removed: because the history reached its max_size, or by set_max_size(), shrink() or evict_oldest_commit()
+    observer.on_execute(command, time, time);     // Called with the time when the command started and finished executing
+    observer.on_revert(command, time, time);      // Called with the time when the command started and finished reverting
+    observer.on_move_forward(count, time, time);  // Called with the number of commands in the group, and the time when executing the whole group started and finished
+    observer.on_move_backward(count, time, time); // Called with the number of commands in the group, and the time when reverting the whole group started and finished
+};
+
+/// The default observer, that does nothing.
+struct NoHistoryObserver {
+    template<typename CommandT>
+    void on_push(CommandT const&, InstrumentationClock::time_point) {}
+    void on_merge(bool, InstrumentationClock::time_point) {}
+    void on_new_group(InstrumentationClock::time_point) {}
+    void on_eviction(size_t, InstrumentationClock::time_point) {}
+    template<typename CommandT>
+    void on_execute(CommandT const&, InstrumentationClock::time_point, InstrumentationClock::time_point) {}
+    template<typename CommandT>
+    void on_revert(CommandT const&, InstrumentationClock::time_point, InstrumentationClock::time_point) {}
+    void on_move_forward(size_t, InstrumentationClock::time_point, InstrumentationClock::time_point) {}
+    void on_move_backward(size_t, InstrumentationClock::time_point, InstrumentationClock::time_point) {}
+};
+
+/// An observer that gathers some statistics about the usage of the history.
+class HistoryStats {
+public:
+    auto pushes_count() const -> size_t { return _pushes_count; }
+    auto merge_attempts_count() const -> size_t { return _merge_attempts_count; }
+    auto merge_hits_count() const -> size_t { return _merge_hits_count; }
+    /// Between 0 and 1
+    auto merge_hit_rate() const -> float
+    {
+        return _merge_attempts_count == 0
+                   ? 0.f
+                   : static_cast<float>(_merge_hits_count) / static_cast<float>(_merge_attempts_count);
+    }
+    auto groups_count() const -> size_t { return _groups_count; }
+    /// Average number of commands in the groups that have been created (commands that got merged don't count)
+    auto average_group_size() const -> float
+    {
+        return _groups_count == 0
+                   ? 0.f
+                   : static_cast<float>(_pushes_count - _merge_hits_count) / static_cast<float>(_groups_count);
+    }
+    auto commits_evicted_count() const -> size_t { return _commits_evicted_count; }
+    auto commits_compacted_count() const -> size_t { return _commits_compacted_count; } // The number of commits that have been removed by folding them into other ones, see `History::compact_old_commits()`
+    auto time_spent_compacting() const -> InstrumentationClock::duration { return _time_spent_compacting; }
+    auto executed_commands_count() const -> size_t { return _executed_commands_count; }
+    auto reverted_commands_count() const -> size_t { return _reverted_commands_count; }
+    auto time_spent_executing() const -> InstrumentationClock::duration { return _time_spent_executing; }
+    auto time_spent_reverting() const -> InstrumentationClock::duration { return _time_spent_reverting; }
+    auto move_forward_count() const -> size_t { return _move_forward_count; }
+    auto move_backward_count() const -> size_t { return _move_backward_count; }
+
+    void reset() { *this = HistoryStats{}; }
+
+    // ---Observer API---
+    template<typename CommandT>
+    void on_push(CommandT const&, InstrumentationClock::time_point)
+    {
+        _pushes_count++;
+    }
+    void on_merge(bool merged, InstrumentationClock::time_point)
+    {
+        _merge_attempts_count++;
+        if (merged)
+            _merge_hits_count++;
+    }
+    void on_new_group(InstrumentationClock::time_point)
+    {
+        _groups_count++;
+    }
+    void on_eviction(size_t count, InstrumentationClock::time_point)
+    {
+        _commits_evicted_count += count;
+    }
+    void on_compaction(size_t count, InstrumentationClock::time_point begin, InstrumentationClock::time_point end)
+    {
+        _commits_compacted_count += count;
+        _time_spent_compacting += end - begin;
+    }
+    template<typename CommandT>
+    void on_execute(CommandT const&, InstrumentationClock::time_point begin, InstrumentationClock::time_point end)
+    {
+        _executed_commands_count++;
+        _time_spent_executing += end - begin;
+    }
+    template<typename CommandT>
+    void on_revert(CommandT const&, InstrumentationClock::time_point begin, InstrumentationClock::time_point end)
+    {
+        _reverted_commands_count++;
+        _time_spent_reverting += end - begin;
+    }
+    void on_move_forward(size_t, InstrumentationClock::time_point, InstrumentationClock::time_point)
+    {
+        _move_forward_count++;
+    }
+    void on_move_backward(size_t, InstrumentationClock::time_point, InstrumentationClock::time_point)
+    {
+        _move_backward_count++;
+    }
+
+private:
+    size_t                         _pushes_count{0};
+    size_t                         _merge_attempts_count{0};
+    size_t                         _merge_hits_count{0};
+    size_t                         _groups_count{0};
+    size_t                         _commits_evicted_count{0};
+    size_t                         _commits_compacted_count{0};
+    size_t                         _executed_commands_count{0};
+    size_t                         _reverted_commands_count{0};
+    size_t                         _move_forward_count{0};
+    size_t                         _move_backward_count{0};
+    InstrumentationClock::duration _time_spent_executing{0};
+    InstrumentationClock::duration _time_spent_reverting{0};
+    InstrumentationClock::duration _time_spent_compacting{0};
+};
+
+namespace internal {
+
+/// When we don't observe anything we don't even want to query the clock.
+template<typename ObserverT>
+constexpr bool is_observing = !std::is_same_v<ObserverT, NoHistoryObserver>;
+
+template<typename ObserverT>
+auto now() -> InstrumentationClock::time_point
+{
+    if constexpr (is_observing<ObserverT>)
+        return InstrumentationClock::now();
+    else
+        return {};
+}
+
+/// Observers can optionally be notified once for a whole batch of commands given to the batch hook of an executor (see BatchExecutorC), by providing `on_execute_batch(commands, begin, end)`.
+/// Otherwise `on_execute()` is called for each command of the batch, with the duration of the batch split evenly between them, so that the durations still add up to the one of the batch.
+template<typename ObserverT, typename CommandT>
+void notify_execute_batch(ObserverT& observer, std::span<CommandT const> commands, InstrumentationClock::time_point begin, InstrumentationClock::time_point end)
+{
+    if constexpr (requires { observer.on_execute_batch(commands, begin, end); })
+    {
+        observer.on_execute_batch(commands, begin, end);
+    }
+    else if constexpr (is_observing<ObserverT>)
+    {
+        auto const count = static_cast<InstrumentationClock::duration::rep>(commands.size());
+        for (size_t i = 0; i < commands.size(); ++i)
+        {
+            auto const index = static_cast<InstrumentationClock::duration::rep>(i);
+            observer.on_execute(commands[i], begin + (end - begin) * index / count, begin + (end - begin) * (index + 1) / count);
+        }
+    }
+}
+
+/// Observers can optionally be notified when `History::compact_old_commits()` removes commits by folding them into other ones, by providing `on_compaction(count, begin, end)`.
+/// This is not an eviction: the commands of these commits are still in the history.
+template<typename ObserverT>
+void notify_compaction(ObserverT& observer, size_t removed_commits_count, InstrumentationClock::time_point begin, InstrumentationClock::time_point end)
+{
+    if constexpr (requires { observer.on_compaction(removed_commits_count, begin, end); })
+        observer.on_compaction(removed_commits_count, begin, end);
+}
+
+} // namespace internal
+
+} // namespace cmd
@@ -0,0 +1,139 @@
+#pragma once
+
+/// Many commands carry copies of the same large payloads (e.g. the same buffer pasted several times, or the same preset applied over and over).
+/// A PayloadStore makes sure that identical payloads are only stored once: commands hold an Interned<PayloadT> handle instead of the payload itself.
+/// The payloads are reference-counted, so a payload is released as soon as the last command that uses it is evicted from the history.
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+namespace cmd {
+
+/// A handle to a payload stored in a PayloadStore. Copying it is cheap, and the payload can't be modified.
+template<typename PayloadT>
+class Interned {
+public:
+    Interned() = default; // Empty handle, only meant for deserialization
+
+    auto get() const -> PayloadT const& { return *_payload; }
+    auto operator*() const -> PayloadT const& { return *_payload; }
+    auto operator->() const -> PayloadT const* { return _payload.get(); }
+
+    /// Two handles coming from the same store are equal iff their payloads are equal
+    friend auto operator==(Interned const& a, Interned const& b) -> bool { return a._payload == b._payload; }
+
+    // Exposed for serialization purposes. Don't use this unless you have a really good reason to.
+    auto unsafe_shared_ptr() const -> std::shared_ptr<PayloadT const> const& { return _payload; }
+
+private:
+    template<typename P, typename Hash, typename Equal>
+    friend class PayloadStore;
+
+    explicit Interned(std::shared_ptr<PayloadT const> payload)
+        : _payload{std::move(payload)}
+    {}
+
+private:
+    std::shared_ptr<PayloadT const> _payload{};
+};
+
+/// Content-addressed store: interning a payload that is equal to one that is already stored gives you a handle to the stored one.
+/// The store doesn't keep the payloads alive, only the handles do.
+/// NB: it is safe to use the same store from several threads.
+template<typename PayloadT, typename Hash = std::hash<PayloadT>, typename Equal = std::equal_to<PayloadT>>
+class PayloadStore {
+public:
+    auto intern(PayloadT const& payload) -> Interned<PayloadT>
+    {
+        return intern_impl(payload, [&]() { return make_payload(payload); });
+    }
+
+    auto intern(PayloadT&& payload) -> Interned<PayloadT>
+    {
+        return intern_impl(payload, [&]() { return make_payload(std::move(payload)); });
+    }
+
+    /// Adopts the given payload, unless an equal one is already stored
+    auto intern(std::unique_ptr<PayloadT> payload) -> Interned<PayloadT>
+    {
+        return intern_impl(*payload, [&]() { return std::shared_ptr<PayloadT const>{std::move(payload)}; });
+    }
+
+    /// Adopts the given payload, unless an equal one is already stored.
+    /// The payload might have been allocated with std::make_shared(), in which case the weak_ptr in _entries would keep its memory alive (see make_payload()),
+    /// so the handles share a new reference count that only keeps the given pointer alive as long as one of them is still alive. Prefer the std::unique_ptr overload, which doesn't need that extra allocation.
+    auto intern(std::shared_ptr<PayloadT const> payload) -> Interned<PayloadT>
+    {
+        return intern_impl(*payload, [&]() {
+            auto const* const address = payload.get();
+            return std::shared_ptr<PayloadT const>{address, [payload = std::move(payload)](PayloadT const*) mutable { payload.reset(); }}; // The deleter is only destroyed once the weak_ptrs are gone too, so it must release the payload itself
+        });
+    }
+
+    /// Number of distinct payloads that are still alive
+    auto size() const -> size_t
+    {
+        auto const lock = std::lock_guard{_mutex};
+        remove_expired_entries();
+        return _entries.size();
+    }
+
+    /// The store used when deserializing Interned payloads
+    static auto global() -> PayloadStore&
+    {
+        static auto instance = PayloadStore{};
+        return instance;
+    }
+
+private:
+    template<typename MakePayload>
+    auto intern_impl(PayloadT const& payload, MakePayload&& make_stored_payload) -> Interned<PayloadT>
+    {
+        auto const hash = Hash{}(payload);
+        auto const lock = std::lock_guard{_mutex};
+        for (auto [it, end] = _entries.equal_range(hash); it != end;)
+        {
+            if (auto stored = it->second.lock())
+            {
+                if (Equal{}(*stored, payload))
+                    return Interned<PayloadT>{std::move(stored)};
+                ++it;
+            }
+            else
+            {
+                it = _entries.erase(it);
+            }
+        }
+        auto stored = make_stored_payload();
+        _entries.emplace(hash, stored);
+        if (_entries.size() >= 2 * _entries_count_after_last_cleanup + 16) // Amortizes the cost of removing the entries whose payload has been released
+        {
+            remove_expired_entries();
+            _entries_count_after_last_cleanup = _entries.size();
+        }
+        return Interned<PayloadT>{std::move(stored)};
+    }
+
+    template<typename P>
+    static auto make_payload(P&& payload) -> std::shared_ptr<PayloadT const>
+    {
+        // Not std::make_shared() because it would allocate the payload and the reference counts together, and the weak_ptr in _entries would then keep the payload's memory alive
+        return std::shared_ptr<PayloadT const>{new PayloadT(std::forward<P>(payload))};
+    }
+
+    void remove_expired_entries() const
+    {
+        std::erase_if(_entries, [](auto const& entry) { return entry.second.expired(); });
+    }
+
+private:
+    mutable std::mutex                                                     _mutex{};
+    mutable std::unordered_multimap<size_t, std::weak_ptr<PayloadT const>> _entries{};
+    size_t                                                                 _entries_count_after_last_cleanup{0};
+};
+
+} // namespace cmd
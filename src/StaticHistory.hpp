@@ -0,0 +1,157 @@
+#pragma once
+#include <array>
+#include <concepts>
+#include <cstddef>
+#include <span>
+#include <utility>
+#include "Command.hpp"
+#include "Executor.hpp"
+
+namespace cmd {
+
+/// An History with a capacity fixed at compile time, that never allocates: all the commands are stored inline.
+/// This makes it usable on real-time threads (audio, rendering), and all its operations are constexpr.
+/// It has the same push / move_forward / move_backward / merging semantics as History, except that:
+///  - a group can contain at most MaxCommandsPerGroup commands: when it is full, the next command goes into a new group.
+///  - there is no observer, and max_size can't be changed.
+///  - dont_merge_next_command() is not const.
+/// NB: the commands that get discarded are only destroyed when their slot is reused by another command.
+template<CommandC CommandT, size_t MaxCommits, size_t MaxCommandsPerGroup>
+    requires std::default_initializable<CommandT>
+class StaticHistory {
+    static_assert(MaxCommits > 0 && MaxCommandsPerGroup > 0);
+
+public:
+    constexpr StaticHistory() = default;
+
+    template<typename ExecutorT>
+        requires ExecutorC<ExecutorT, CommandT>
+    constexpr void move_forward(ExecutorT& executor)
+    {
+        if (_next_command_group_to_execute != _size)
+        {
+            for (auto const& command : command_group(_next_command_group_to_execute))
+                executor.execute(command);
+            _next_command_group_to_execute++;
+        }
+        _can_try_to_merge_next_command        = false;
+        _should_put_next_command_in_new_group = true;
+    }
+
+    template<typename ReverterT>
+        requires ReverterC<ReverterT, CommandT>
+    constexpr void move_backward(ReverterT& reverter)
+    {
+        if (_next_command_group_to_execute != 0)
+        {
+            // We want to undo in the reverse order compared to when we do
+            auto const commands = command_group(_next_command_group_to_execute - 1);
+            for (auto it = commands.rbegin(); it != commands.rend(); ++it)
+                reverter.revert(*it);
+            _next_command_group_to_execute--;
+        }
+        _can_try_to_merge_next_command        = false;
+        _should_put_next_command_in_new_group = true;
+    }
+
+    template<typename MergerT>
+        requires MergerC<MergerT, CommandT>
+    constexpr void push(const CommandT& command, const MergerT& merger)
+    {
+        push_impl(command, merger);
+    }
+
+    template<typename MergerT>
+        requires MergerC<MergerT, CommandT>
+    constexpr void push(CommandT&& command, const MergerT& merger)
+    {
+        push_impl(std::move(command), merger);
+    }
+
+    /// The history is eager to merge commands: it will try to do it unless you explicitly tell it not to
+    constexpr void dont_merge_next_command() { _can_try_to_merge_next_command = false; }
+    constexpr void start_new_commands_group() { _should_put_next_command_in_new_group = true; }
+
+    constexpr auto size() const -> size_t { return _size; }
+    static constexpr auto max_size() -> size_t { return MaxCommits; }
+    static constexpr auto max_commands_per_group() -> size_t { return MaxCommandsPerGroup; }
+
+    /// Index of the group that will be executed by the next call to move_forward(). Equal to size() if there is none.
+    constexpr auto current_command_group_index() const -> size_t { return _next_command_group_to_execute; }
+
+    /// The commands of the commit at the given index, 0 being the oldest commit
+    constexpr auto command_group(size_t index) const -> std::span<CommandT const>
+    {
+        auto const& group = group_at(index);
+        return std::span<CommandT const>{group.commands.data(), group.size};
+    }
+
+private:
+    struct CommandGroup {
+        std::array<CommandT, MaxCommandsPerGroup> commands{};
+        size_t                                    size{0};
+    };
+
+    template<typename CommandType, typename MergerType> // CommandType instead of CommandT to not override CommandT which is already the template parameter of the whole class; CommandT and CommandType need to be different otherwise perfect forwarding won't kick in
+    constexpr void push_impl(CommandType&& command, const MergerType& merger)
+    {
+        _size = _next_command_group_to_execute; // Discards all the commits after the current one
+        if (_size != 0
+            && _can_try_to_merge_next_command)
+        {
+            auto& last_group   = group_at(_size - 1);
+            auto& last_command = last_group.commands[last_group.size - 1]; // Safe because we never have empty command groups
+            auto  merged       = internal::merge(merger, last_command, command);
+            if (merged.cancels_out())
+            {
+                last_group.size--;
+                if (last_group.size == 0)
+                {
+                    _size--;
+                    _should_put_next_command_in_new_group = true;
+                }
+                _next_command_group_to_execute = _size;
+                _can_try_to_merge_next_command = false; // We don't know if the command that is now the last one could be merged with the one that was before it
+                return;
+            }
+            if (merged)
+            {
+                last_command                   = std::move(merged.command());
+                _next_command_group_to_execute = _size;
+                return;
+            }
+        }
+
+        if (_should_put_next_command_in_new_group
+            || _size == 0
+            || group_at(_size - 1).size == MaxCommandsPerGroup)
+        {
+            if (_size == MaxCommits) // Evicts the oldest commit
+            {
+                _first = (_first + 1) % MaxCommits;
+                _size--;
+            }
+            group_at(_size).size = 0;
+            _size++;
+        }
+        _should_put_next_command_in_new_group = false;
+        auto& last_group                      = group_at(_size - 1);
+        last_group.commands[last_group.size]  = std::forward<CommandType>(command);
+        last_group.size++;
+        _next_command_group_to_execute = _size;
+        _can_try_to_merge_next_command = true;
+    }
+
+    constexpr auto group_at(size_t index) -> CommandGroup& { return _groups[(_first + index) % MaxCommits]; }
+    constexpr auto group_at(size_t index) const -> CommandGroup const& { return _groups[(_first + index) % MaxCommits]; }
+
+private:
+    std::array<CommandGroup, MaxCommits> _groups{};
+    size_t                               _first{0}; // Index in _groups of the oldest commit
+    size_t                               _size{0};
+    size_t                               _next_command_group_to_execute{0};
+    bool                                 _can_try_to_merge_next_command{false}; // Not mutable, because GCC 12 refuses to read mutable members in constant expressions
+    bool                                 _should_put_next_command_in_new_group{true};
+};
+
+} // namespace cmd
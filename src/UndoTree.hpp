@@ -0,0 +1,545 @@
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+#include "Command.hpp"
+#include "Executor.hpp"
+#include "HistoryObserver.hpp"
+
+namespace cmd {
+
+/// An alternative to History that never discards the redo branch.
+/// When you push a command after moving backward, a new branch is created that shares all the previous commits with the existing ones.
+/// This costs nothing up front: a branch is just a new node in the tree, pointing to the commit it forks from.
+/// You can then list the branches and switch between them.
+///
+/// max_size is the number of commits across all branches. When it is reached, we first remove the least recently visited branches,
+/// and then the oldest commits, like History does.
+template<CommandC CommandT, HistoryObserverC<CommandT> ObserverT = NoHistoryObserver>
+class UndoTree {
+public:
+    using CommandGroup = std::vector<CommandT>;
+    /// Identifies a commit of the tree. It stays valid as long as that commit is not removed from the tree.
+    using CommitId = uint64_t;
+
+    struct BranchInfo {
+        /// The commit at the tip of the branch
+        CommitId tip;
+        /// Number of commits between the oldest commit of the tree and the tip of the branch
+        size_t length;
+        /// Number of commits that this branch shares with the current branch
+        size_t common_length_with_current_branch;
+        /// True iff the current commit is on this branch, i.e. you can reach its tip by only moving forward
+        bool is_current;
+    };
+
+    explicit UndoTree(size_t max_size = 1000, ObserverT observer = {})
+        : _max_size{max_size}
+        , _observer{std::move(observer)}
+    {}
+
+    ~UndoTree() { destroy_iteratively(std::move(_root)); }
+    UndoTree(UndoTree&& other) noexcept
+        : _root{std::move(other._root)}
+        , _current{std::exchange(other._current, nullptr)}
+        , _leaves{std::move(other._leaves)}
+        , _max_size{other._max_size}
+        , _commits_count{std::exchange(other._commits_count, 0)}
+        , _nodes_byte_size{std::exchange(other._nodes_byte_size, 0)}
+        , _next_id{other._next_id}
+        , _visit_clock{other._visit_clock}
+        , _can_try_to_merge_next_command{other._can_try_to_merge_next_command}
+        , _should_put_next_command_in_new_group{other._should_put_next_command_in_new_group}
+        , _observer{std::move(other._observer)}
+    {} // NB: a moved-from tree can only be destroyed or assigned to
+    auto operator=(UndoTree&& other) noexcept -> UndoTree&
+    {
+        auto tmp = UndoTree{std::move(other)};
+        swap(tmp);
+        return *this;
+    }
+    UndoTree(UndoTree const&)                    = delete; // Use `clone()` instead
+    auto operator=(UndoTree const&) -> UndoTree& = delete; // if you really want a copy of your tree
+
+    auto clone() const -> UndoTree
+    {
+        auto copy                                  = UndoTree{_max_size, _observer};
+        copy._commits_count                        = _commits_count;
+        copy._next_id                              = _next_id;
+        copy._visit_clock                          = _visit_clock;
+        copy._can_try_to_merge_next_command        = _can_try_to_merge_next_command;
+        copy._should_put_next_command_in_new_group = _should_put_next_command_in_new_group;
+        copy._leaves.clear();
+
+        copy._root->id         = _root->id;
+        copy._root->depth      = _root->depth;
+        copy._root->last_visit = _root->last_visit;
+        auto to_copy           = std::vector<std::pair<Node const*, Node*>>{{_root.get(), copy._root.get()}}; // (original, copy)
+        while (!to_copy.empty())
+        {
+            auto const [original, node] = to_copy.back();
+            to_copy.pop_back();
+            if (original == _current)
+                copy._current = node;
+            if (original->children.empty())
+                copy._leaves.push_back(node);
+            for (auto const& original_child : original->children)
+            {
+                auto& child = node->children.emplace_back(std::make_unique<Node>(Node{
+                    .commands   = original_child->commands,
+                    .parent     = node,
+                    .depth      = original_child->depth,
+                    .id         = original_child->id,
+                    .last_visit = original_child->last_visit,
+                }));
+                if (original->next_to_execute == original_child.get())
+                    node->next_to_execute = child.get();
+                to_copy.emplace_back(original_child.get(), child.get());
+            }
+            copy.set_byte_size(*node, owned_byte_size(*node)); // The capacities of the copies might not be the same as the ones of the originals
+        }
+        return copy;
+    }
+
+    /// Moves to the child of the current commit that was visited the most recently.
+    template<typename ExecutorT>
+        requires ExecutorC<ExecutorT, CommandT>
+    void move_forward(ExecutorT& executor)
+    {
+        if (_current->next_to_execute)
+            execute(*_current->next_to_execute, executor);
+        _can_try_to_merge_next_command        = false;
+        _should_put_next_command_in_new_group = true;
+    }
+
+    template<typename ReverterT>
+        requires ReverterC<ReverterT, CommandT>
+    void move_backward(ReverterT& reverter)
+    {
+        if (_current->parent)
+            revert(*_current, reverter);
+        _can_try_to_merge_next_command        = false;
+        _should_put_next_command_in_new_group = true;
+    }
+
+    template<typename MergerT>
+        requires MergerC<MergerT, CommandT>
+    void push(const CommandT& command, const MergerT& merger)
+    {
+        push_impl(command, merger);
+    }
+
+    template<typename MergerT>
+        requires MergerC<MergerT, CommandT>
+    void push(CommandT&& command, const MergerT& merger)
+    {
+        push_impl(std::move(command), merger);
+    }
+
+    /// The tree is eager to merge commands: it will try to do it unless you explicitly tell it not to
+    void dont_merge_next_command() const { _can_try_to_merge_next_command = false; }
+    void start_new_commands_group() { _should_put_next_command_in_new_group = true; }
+
+    /// Number of commits, across all the branches
+    auto size() const -> size_t { return _commits_count; }
+    auto max_size() const -> size_t { return _max_size; }
+    void set_max_size(size_t new_max_size)
+    {
+        _max_size = new_max_size;
+        shrink_to_max_size();
+    }
+
+    /// Number of bytes used by all the commits of all the branches, counted the same way as `History::memory_usage()`: with the capacity of the vectors, and the memory footprint of the commands (see HasMemoryFootprintC).
+    auto memory_usage() const -> size_t
+    {
+        return (_commits_count + 1) * sizeof(Node) // +1 for the root
+               + _nodes_byte_size
+               + _leaves.capacity() * sizeof(Node*);
+    }
+
+    auto current_commit() const -> CommitId { return _current->id; }
+
+    /// The branches, sorted from the most recently visited to the least recently visited.
+    auto branches() const -> std::vector<BranchInfo>
+    {
+        auto leaves = _leaves;
+        std::sort(leaves.begin(), leaves.end(), [](Node const* a, Node const* b) { return a->last_visit > b->last_visit; });
+
+        auto res = std::vector<BranchInfo>{};
+        res.reserve(leaves.size());
+        Node const* const current_tip = tip_of_current_branch();
+        for (Node const* leaf : leaves)
+        {
+            res.push_back({
+                .tip                               = leaf->id,
+                .length                            = leaf->depth - _root->depth,
+                .common_length_with_current_branch = common_ancestor(*leaf, *current_tip).depth - _root->depth,
+                .is_current                        = leaf == current_tip,
+            });
+        }
+        return res;
+    }
+
+    /// Moves to the tip of the given branch. Only the commits that are not shared between the current commit and the tip of the branch are reverted / executed.
+    /// Returns false iff there is no branch with this id.
+    template<typename ExecutorT>
+        requires ExecutorC<ExecutorT, CommandT> && ReverterC<ExecutorT, CommandT>
+    auto switch_to_branch(CommitId branch_tip, ExecutorT& executor) -> bool
+    {
+        auto const leaf = std::find_if(_leaves.begin(), _leaves.end(), [&](Node const* node) { return node->id == branch_tip; });
+        if (leaf == _leaves.end())
+            return false;
+        move_to(**leaf, executor);
+        return true;
+    }
+
+    /// Moves to the given commit, which can be in any branch. Only the commits that are not shared between the current commit and the target one are reverted / executed.
+    /// Returns false iff there is no commit with this id.
+    template<typename ExecutorT>
+        requires ExecutorC<ExecutorT, CommandT> && ReverterC<ExecutorT, CommandT>
+    auto move_to_commit(CommitId commit, ExecutorT& executor) -> bool
+    {
+        Node* const target = find(commit);
+        if (!target)
+            return false;
+        move_to(*target, executor);
+        return true;
+    }
+
+    auto observer() const -> ObserverT const& { return _observer; }
+    auto observer() -> ObserverT& { return _observer; }
+
+private:
+    struct Node {
+        CommandGroup                       commands{};
+        Node*                              parent{nullptr};
+        std::vector<std::unique_ptr<Node>> children{};
+        Node*                              next_to_execute{nullptr}; // The child that we go to when moving forward
+        size_t                             depth{0};
+        CommitId                           id{0};
+        uint64_t                           last_visit{0};
+        size_t                             byte_size{0}; // The memory owned by the node, on top of sizeof(Node), see `owned_byte_size()`
+    };
+
+    template<typename ExecutorT>
+    void move_to(Node& target, ExecutorT& executor)
+    {
+        Node& ancestor = common_ancestor(*_current, target);
+        while (_current != &ancestor)
+            revert(*_current, executor);
+
+        auto path = std::vector<Node*>{};
+        for (Node* node = &target; node != &ancestor; node = node->parent)
+            path.push_back(node);
+        for (auto it = path.rbegin(); it != path.rend(); ++it)
+            execute(**it, executor);
+
+        _can_try_to_merge_next_command        = false;
+        _should_put_next_command_in_new_group = true;
+    }
+
+    template<typename ExecutorT>
+    void execute(Node& node, ExecutorT& executor)
+    {
+        assert(node.parent == _current);
+        auto const group_begin = internal::now<ObserverT>();
+        for (auto const& command : node.commands)
+        {
+            auto const begin = internal::now<ObserverT>();
+            executor.execute(command); // TODO if one of the commands throws, this can mess up the state. We should probably provide the strong guarantee.
+            _observer.on_execute(command, begin, internal::now<ObserverT>());
+        }
+        _observer.on_move_forward(node.commands.size(), group_begin, internal::now<ObserverT>());
+        _current->next_to_execute = &node;
+        _current                  = &node;
+        visit(*_current);
+    }
+
+    template<typename ReverterT>
+    void revert(Node& node, ReverterT& reverter)
+    {
+        assert(&node == _current && node.parent);
+        auto const group_begin = internal::now<ObserverT>();
+        // We want to undo in the reverse order compared to when we do
+        for (auto it = node.commands.rbegin(); it != node.commands.rend(); ++it)
+        {
+            auto const begin = internal::now<ObserverT>();
+            reverter.revert(*it); // TODO if one of the commands throws, this can mess up the state. We should probably provide the strong guarantee.
+            _observer.on_revert(*it, begin, internal::now<ObserverT>());
+        }
+        _observer.on_move_backward(node.commands.size(), group_begin, internal::now<ObserverT>());
+        _current = node.parent;
+        visit(*_current);
+    }
+
+    template<typename CommandType, typename MergerType> // CommandType instead of CommandT to not override CommandT which is already the template parameter of the whole class; CommandT and CommandType need to be different otherwise perfect forwarding won't kick in
+    void push_impl(CommandType&& command, const MergerType& merger)
+    {
+        if (_max_size == 0)
+            return;
+
+        _observer.on_push(command, internal::now<ObserverT>());
+
+        // We can only add to the current commit if this doesn't invalidate the commits that come after it
+        bool const can_modify_current_commit = _current->parent && _current->children.empty();
+        if (can_modify_current_commit && _can_try_to_merge_next_command)
+        {
+            auto& last_command = _current->commands.back(); // back() is safe because we should never have empty command groups.
+            auto  merged       = internal::merge(merger, last_command, command);
+            _observer.on_merge(merged.is_merged(), internal::now<ObserverT>());
+            if (merged.cancels_out())
+            {
+                remove_last_command_of_current_commit();
+                return;
+            }
+            if (merged)
+            {
+                auto const footprint_before    = internal::memory_footprint_of(last_command);
+                last_command                   = std::move(merged.command());
+                _can_try_to_merge_next_command = true;
+                on_commit_modified(*_current, _current->commands.capacity(), internal::memory_footprint_of(last_command), footprint_before);
+                return;
+            }
+        }
+
+        if (_should_put_next_command_in_new_group || !can_modify_current_commit)
+        {
+            add_child_to_current_commit();
+            _observer.on_new_group(internal::now<ObserverT>());
+        }
+        _should_put_next_command_in_new_group = false;
+        auto const capacity_before            = _current->commands.capacity();
+        _current->commands.push_back(std::forward<CommandType>(command));
+        on_commit_modified(*_current, capacity_before, internal::memory_footprint_of(_current->commands.back()), 0);
+        _can_try_to_merge_next_command = true;
+        shrink_to_max_size();
+    }
+
+    /// The last command and the one we were pushing cancel out, so we get rid of both of them (and of the current commit if it becomes empty)
+    void remove_last_command_of_current_commit()
+    {
+        Node* const commit    = _current;
+        auto const  footprint = internal::memory_footprint_of(commit->commands.back());
+        commit->commands.pop_back();
+        on_commit_modified(*commit, commit->commands.capacity(), 0, footprint);
+        if (commit->commands.empty())
+        {
+            _current = commit->parent;
+            visit(*_current);
+            remove_leaf(std::find(_leaves.begin(), _leaves.end(), commit));
+            _should_put_next_command_in_new_group = true;
+        }
+        _can_try_to_merge_next_command = false; // We don't know if the command that is now the last one could be merged with the one that was before it
+    }
+
+    /// Forks a new branch if the current commit already has children
+    void add_child_to_current_commit()
+    {
+        if (_current->children.empty())
+            std::erase(_leaves, _current);
+        auto const children_capacity_before = _current->children.capacity();
+        Node&      child                    = *_current->children.emplace_back(std::make_unique<Node>(Node{
+            .parent = _current,
+            .depth  = _current->depth + 1,
+            .id     = _next_id++,
+        }));
+        set_byte_size(*_current, _current->byte_size + (_current->children.capacity() - children_capacity_before) * sizeof(std::unique_ptr<Node>));
+        _leaves.push_back(&child);
+        _current->next_to_execute = &child;
+        _current                  = &child;
+        _commits_count++;
+        visit(*_current);
+    }
+
+    void shrink_to_max_size()
+    {
+        size_t evicted_count = 0;
+        while (_commits_count > _max_size)
+        {
+            if (!remove_least_recently_visited_branch())
+                remove_oldest_commit();
+            evicted_count++;
+        }
+        if (evicted_count != 0)
+            _observer.on_eviction(evicted_count, internal::now<ObserverT>());
+    }
+
+    /// Removes the tip of the least recently visited branch, unless it is the current commit or one that we can reach by moving forward.
+    /// Returns false iff there was no such branch.
+    auto remove_least_recently_visited_branch() -> bool
+    {
+        Node const* const current_tip = tip_of_current_branch();
+        auto              to_remove   = _leaves.end();
+        for (auto it = _leaves.begin(); it != _leaves.end(); ++it)
+        {
+            if (*it != current_tip
+                && (to_remove == _leaves.end() || (*it)->last_visit < (*to_remove)->last_visit))
+            {
+                to_remove = it;
+            }
+        }
+        if (to_remove == _leaves.end())
+            return false;
+        remove_leaf(to_remove);
+        return true;
+    }
+
+    /// There is only the current branch left.
+    void remove_oldest_commit()
+    {
+        assert(_root->children.size() == 1);
+        if (_current == _root.get())
+        {
+            // We can't remove the past, so we remove the future
+            remove_leaf(std::find(_leaves.begin(), _leaves.end(), tip_of_current_branch()));
+            return;
+        }
+        // The oldest commit becomes the new root: its commands are considered as already applied and can't be reverted anymore
+        auto new_root = std::move(_root->children.front());
+        _nodes_byte_size -= _root->byte_size;
+        new_root->commands = CommandGroup{};
+        new_root->parent   = nullptr;
+        set_byte_size(*new_root, owned_byte_size(*new_root));
+        _root = std::move(new_root);
+        _commits_count--;
+    }
+
+    void remove_leaf(typename std::vector<Node*>::iterator leaf_it)
+    {
+        Node* const leaf   = *leaf_it;
+        Node* const parent = leaf->parent;
+        assert(leaf != _current && leaf->children.empty() && parent);
+        _nodes_byte_size -= leaf->byte_size;
+        _commits_count--;
+        _leaves.erase(leaf_it);
+        std::erase_if(parent->children, [&](auto const& child) { return child.get() == leaf; });
+        if (parent->children.empty())
+        {
+            _leaves.push_back(parent);
+            parent->next_to_execute = nullptr;
+        }
+        else if (parent->next_to_execute == leaf)
+        {
+            parent->next_to_execute = std::max_element(parent->children.begin(), parent->children.end(), [](auto const& a, auto const& b) {
+                                          return a->last_visit < b->last_visit;
+                                      })->get();
+        }
+    }
+
+    auto tip_of_current_branch() const -> Node const*
+    {
+        Node const* node = _current;
+        while (node->next_to_execute)
+            node = node->next_to_execute;
+        return node;
+    }
+
+    template<typename NodeT> // Node or Node const
+    static auto common_ancestor(NodeT& a, NodeT& b) -> NodeT&
+    {
+        NodeT* node_a = &a;
+        NodeT* node_b = &b;
+        while (node_a->depth > node_b->depth)
+            node_a = node_a->parent;
+        while (node_b->depth > node_a->depth)
+            node_b = node_b->parent;
+        while (node_a != node_b)
+        {
+            node_a = node_a->parent;
+            node_b = node_b->parent;
+        }
+        return *node_a;
+    }
+
+    auto find(CommitId id) -> Node*
+    {
+        auto to_visit = std::vector<Node*>{_root.get()};
+        while (!to_visit.empty())
+        {
+            Node* const node = to_visit.back();
+            to_visit.pop_back();
+            if (node->id == id)
+                return node;
+            for (auto const& child : node->children)
+                to_visit.push_back(child.get());
+        }
+        return nullptr;
+    }
+
+    void visit(Node& node) { node.last_visit = ++_visit_clock; }
+
+    /// The capacity of the vectors of the node, and the memory footprint of its commands.
+    /// NB: this is O(node.commands.size()) when the commands have a memory footprint, so it should only be used when we have to go through the whole node anyways
+    static auto owned_byte_size(Node const& node) -> size_t
+    {
+        auto res = node.commands.capacity() * sizeof(CommandT) + node.children.capacity() * sizeof(std::unique_ptr<Node>);
+        if constexpr (HasMemoryFootprintC<CommandT>)
+        {
+            for (auto const& command : node.commands)
+                res += internal::memory_footprint_of(command);
+        }
+        return res;
+    }
+
+    /// Commands have been added to the commit, merged into it or removed from it. This doesn't go through all the commands of the commit, so that pushing stays O(1).
+    void on_commit_modified(Node& node, size_t capacity_before, size_t added_footprint, size_t removed_footprint)
+    {
+        auto const capacity_after = node.commands.capacity(); // The capacity of a vector never decreases unless we explicitly ask for it
+        set_byte_size(node, node.byte_size + (capacity_after - capacity_before) * sizeof(CommandT) + added_footprint - removed_footprint);
+    }
+
+    void set_byte_size(Node& node, size_t byte_size)
+    {
+        _nodes_byte_size = _nodes_byte_size - node.byte_size + byte_size;
+        node.byte_size   = byte_size;
+    }
+
+    /// Avoids a recursive destruction that could overflow the stack for very deep trees
+    static void destroy_iteratively(std::unique_ptr<Node> root)
+    {
+        auto to_destroy = std::vector<std::unique_ptr<Node>>{};
+        if (root)
+            to_destroy.push_back(std::move(root));
+        while (!to_destroy.empty())
+        {
+            auto node = std::move(to_destroy.back());
+            to_destroy.pop_back();
+            for (auto& child : node->children)
+                to_destroy.push_back(std::move(child));
+        }
+    }
+
+    void swap(UndoTree& other) noexcept
+    {
+        std::swap(_root, other._root);
+        std::swap(_current, other._current);
+        std::swap(_leaves, other._leaves);
+        std::swap(_max_size, other._max_size);
+        std::swap(_commits_count, other._commits_count);
+        std::swap(_nodes_byte_size, other._nodes_byte_size);
+        std::swap(_next_id, other._next_id);
+        std::swap(_visit_clock, other._visit_clock);
+        std::swap(_can_try_to_merge_next_command, other._can_try_to_merge_next_command);
+        std::swap(_should_put_next_command_in_new_group, other._should_put_next_command_in_new_group);
+        std::swap(_observer, other._observer);
+    }
+
+private:
+    std::unique_ptr<Node>           _root{std::make_unique<Node>()}; // Has no commands, represents the state before the oldest commit
+    Node*                           _current{_root.get()};           // The last commit that has been executed
+    std::vector<Node*>              _leaves{_current};
+    size_t                          _max_size;
+    size_t                          _commits_count{0};
+    size_t                          _nodes_byte_size{0}; // Sum of the byte_size of all the nodes
+    CommitId                        _next_id{1};
+    uint64_t                        _visit_clock{0};
+    mutable bool                    _can_try_to_merge_next_command{false};
+    bool                            _should_put_next_command_in_new_group{true};
+    CMD_NO_UNIQUE_ADDRESS ObserverT _observer;
+};
+
+} // namespace cmd
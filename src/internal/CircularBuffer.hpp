@@ -1,132 +1,405 @@
 #pragma once
 
+#include <atomic>
 #include <cassert>
-#include <list>
-#include <optional>
+#include <cstddef>
+#include <deque>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 namespace cmd::internal {
 
-template<typename T>
+inline constexpr size_t default_chunk_size = 32;
+
+/// Elements are stored in chunks of ChunkSize elements, and the chunks are reference-counted and copy-on-write.
+/// This means that copying a CircularBuffer is O(1), and subsequent modifications of either copy only duplicate the chunks they touch.
+/// NB: the table of pointers to the chunks is shared too, so the first modification of a copy also duplicates that table, which is O(size() / ChunkSize).
+/// The next modifications of that copy only duplicate the chunks they touch.
+/// NB: a CircularBuffer and its copies can be used from different threads, but a given CircularBuffer must not be used by several threads at the same time.
+/// All the memory (chunks, table of chunks and reference counts) is allocated through the given Allocator.
+template<typename T, size_t ChunkSize = default_chunk_size, typename Allocator = std::allocator<T>>
 class CircularBuffer {
+    static_assert(ChunkSize > 0);
+
 public:
-    using iterator = typename std::list<T>::iterator;
+    using allocator_type = Allocator;
+
+    class const_iterator {
+    public:
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type        = T;
+        using difference_type   = std::ptrdiff_t;
+        using pointer           = T const*;
+        using reference         = T const&;
+
+        const_iterator() = default;
+        const_iterator(CircularBuffer const* buffer, size_t index)
+            : _buffer{buffer}
+            , _index{index}
+        {}
+
+        auto operator*() const -> reference { return (*_buffer)[_index]; }
+        auto operator->() const -> pointer { return &(*_buffer)[_index]; }
+        auto operator[](difference_type n) const -> reference { return *(*this + n); }
+
+        auto operator++() -> const_iterator&
+        {
+            ++_index;
+            return *this;
+        }
+        auto operator++(int) -> const_iterator
+        {
+            auto tmp = *this;
+            ++_index;
+            return tmp;
+        }
+        auto operator--() -> const_iterator&
+        {
+            --_index;
+            return *this;
+        }
+        auto operator--(int) -> const_iterator
+        {
+            auto tmp = *this;
+            --_index;
+            return tmp;
+        }
+        auto operator+=(difference_type n) -> const_iterator&
+        {
+            _index = static_cast<size_t>(static_cast<difference_type>(_index) + n);
+            return *this;
+        }
+        auto operator-=(difference_type n) -> const_iterator& { return *this += -n; }
+
+        friend auto operator+(const_iterator it, difference_type n) -> const_iterator { return it += n; }
+        friend auto operator+(difference_type n, const_iterator it) -> const_iterator { return it += n; }
+        friend auto operator-(const_iterator it, difference_type n) -> const_iterator { return it -= n; }
+        friend auto operator-(const_iterator const& a, const_iterator const& b) -> difference_type
+        {
+            return static_cast<difference_type>(a._index) - static_cast<difference_type>(b._index);
+        }
+        friend auto operator==(const_iterator const& a, const_iterator const& b) -> bool { return a._index == b._index; }
+        friend auto operator<=>(const_iterator const& a, const_iterator const& b) { return a._index <=> b._index; }
+
+        auto index() const -> size_t { return _index; }
 
-    explicit CircularBuffer(size_t max_size)
+    private:
+        CircularBuffer const* _buffer{nullptr};
+        size_t                _index{0};
+    };
+
+    explicit CircularBuffer(size_t max_size, Allocator const& allocator = {})
         : _max_size{max_size}
+        , _allocator{allocator}
+    {}
+
+    /// Copies share all their chunks, and use the same allocator
+    CircularBuffer(CircularBuffer const&) = default;
+    CircularBuffer(CircularBuffer&& other) noexcept
+        : _chunks{std::move(other._chunks)}
+        , _size{std::exchange(other._size, 0)}
+        , _max_size{other._max_size}
+        , _allocator{other._allocator}
     {}
+    ~CircularBuffer() = default;
 
-    void push_back(const T& t)
+    /// Chunks can only be shared with a CircularBuffer that uses the same allocator, otherwise the elements are copied
+    auto operator=(CircularBuffer const& other) -> CircularBuffer&
     {
-        push_back_impl(t);
+        if (this != &other)
+        {
+            if constexpr (std::allocator_traits<Allocator>::propagate_on_container_copy_assignment::value)
+                _allocator = other._allocator;
+            assign_from(other);
+        }
+        return *this;
     }
 
-    void push_back(T&& t)
+    /// Chunks can only be taken from a CircularBuffer that uses the same allocator, otherwise the elements are moved one by one
+    auto operator=(CircularBuffer&& other) noexcept(std::allocator_traits<Allocator>::is_always_equal::value || std::allocator_traits<Allocator>::propagate_on_container_move_assignment::value) -> CircularBuffer&
     {
-        push_back_impl(std::move(t));
+        if (this != &other)
+        {
+            if constexpr (std::allocator_traits<Allocator>::propagate_on_container_move_assignment::value)
+                _allocator = other._allocator;
+            assign_from(std::move(other));
+        }
+        return *this;
     }
 
-    auto size() const -> size_t { return _container.size(); }
+    auto get_allocator() const -> Allocator { return _allocator; }
+
+    /// Returns the number of elements that had to be removed to keep the size <= max_size
+    auto push_back(const T& t) -> size_t
+    {
+        return push_back_impl(t);
+    }
+
+    /// Returns the number of elements that had to be removed to keep the size <= max_size
+    auto push_back(T&& t) -> size_t
+    {
+        return push_back_impl(std::move(t));
+    }
+
+    auto size() const -> size_t { return _size; }
 
     auto max_size() const -> size_t { return _max_size; }
 
-    void set_max_size(size_t new_max_size)
+    /// Returns the number of elements that have been removed
+    auto set_max_size(size_t new_max_size) -> size_t
     {
         _max_size = new_max_size;
-        shrink_left();
+        return shrink_left();
     }
 
-    void set_max_size_and_preserve_given_iterator(size_t new_max_size, iterator iterator_to_preserve)
+    /// `index_to_preserve` is updated so that it keeps pointing to the same element (or to the end if it was pointing to the end).
+    /// Returns the number of elements that have been removed
+    auto set_max_size_and_preserve_given_index(size_t new_max_size, size_t& index_to_preserve) -> size_t
     {
         _max_size = new_max_size;
-        shrink_while_preserving(iterator_to_preserve);
+        return shrink_while_preserving(index_to_preserve);
     }
 
-    void shrink_and_preserve_given_iterator(size_t new_max_size, iterator iterator_to_preserve)
+    /// `index_to_preserve` is updated so that it keeps pointing to the same element (or to the end if it was pointing to the end).
+    /// Returns the number of elements that have been removed
+    auto shrink_and_preserve_given_index(size_t new_max_size, size_t& index_to_preserve) -> size_t
     {
         const auto tmp = _max_size;
         _max_size      = new_max_size;
-        shrink_while_preserving(iterator_to_preserve);
-        _max_size = tmp;
+        const auto res = shrink_while_preserving(index_to_preserve);
+        _max_size      = tmp;
+        return res;
     }
 
-    void resize(size_t new_size)
+    auto begin() const { return const_iterator{this, 0}; }
+    auto end() const { return const_iterator{this, _size}; }
+
+    auto operator[](size_t index) const -> T const&
     {
-        _container.resize(new_size);
+        assert(index < _size);
+        auto const [chunk_index, index_in_chunk] = position_of(index);
+        return (*(*_chunks)[chunk_index])[index_in_chunk];
     }
+    /// Duplicates the chunk that contains the element if it is shared with another CircularBuffer
+    auto mutable_at(size_t index) -> T&
+    {
+        assert(index < _size);
+        auto const [chunk_index, index_in_chunk] = position_of(index);
+        return mutable_chunk(chunk_index)[index_in_chunk];
+    }
+
+    auto back() const -> T const& { return (*this)[_size - 1]; }
+    /// Duplicates the last chunk if it is shared with another CircularBuffer
+    auto back() -> T& { return mutable_at(_size - 1); }
+
+    void pop_back() { erase_all_starting_at(_size - 1); }
 
-    auto begin() { return _container.begin(); }
-    auto begin() const { return _container.begin(); }
-    auto end() { return _container.end(); }
-    auto end() const { return _container.end(); }
+    void pop_front()
+    {
+        assert(_size > 0);
+        auto& chunks = mutable_chunks();
+        if (chunks.front()->size() == 1)
+            chunks.pop_front();
+        else if (is_shared(chunks.front()))
+            chunks.front() = make_chunk(chunks.front()->begin() + 1, chunks.front()->end()); // Don't copy the element that we are removing
+        else
+            chunks.front()->erase(chunks.front()->begin());
+        _size--;
+    }
 
-    auto back() -> auto& { return _container.back(); }
-    auto back() const -> auto const& { return _container.back(); }
-    void pop_back() { _container.pop_back(); }
+    auto is_empty() const -> bool { return _size == 0; }
 
-    auto is_empty() const -> bool { return _container.empty(); }
+    void erase_all_starting_at(size_t index)
+    {
+        if (index >= _size)
+            return;
+        auto& chunks = mutable_chunks();
+        while (!chunks.empty() && _size - chunks.back()->size() >= index)
+        {
+            _size -= chunks.back()->size();
+            chunks.pop_back();
+        }
+        if (_size == index)
+            return;
+        auto const new_last_chunk_size = static_cast<std::ptrdiff_t>(chunks.back()->size() - (_size - index));
+        if (is_shared(chunks.back()))
+            chunks.back() = make_chunk(chunks.back()->begin(), chunks.back()->begin() + new_last_chunk_size); // Don't copy the elements that we are removing
+        else
+            chunks.back()->erase(chunks.back()->begin() + new_last_chunk_size, chunks.back()->end());
+        _size = index;
+    }
 
-    void erase_all_starting_at(iterator it)
+    /// Removes the elements in [first, last).
+    /// We shift whichever side of the erased range is the smallest, so erasing close to the front or to the back is cheap.
+    void erase(size_t first, size_t last)
     {
-        _container.erase(it, _container.end());
+        assert(first <= last && last <= _size);
+        auto const count = last - first;
+        if (count == 0)
+            return;
+        if (first < _size - last)
+        {
+            for (size_t i = first; i-- > 0;)
+                mutable_at(i + count) = std::move(mutable_at(i));
+            for (size_t i = 0; i < count; ++i)
+                pop_front();
+        }
+        else
+        {
+            for (size_t i = last; i < _size; ++i)
+                mutable_at(i - count) = std::move(mutable_at(i));
+            erase_all_starting_at(_size - count);
+        }
     }
 
-    auto underlying_container() -> std::list<T>& { return _container; }
-    auto underlying_container() const -> std::list<T> const& { return _container; }
+    void clear()
+    {
+        _chunks.reset();
+        _size = 0;
+    }
 
 private:
+    using Chunk  = std::vector<T, Allocator>;
+    using Chunks = std::deque<std::shared_ptr<Chunk>, typename std::allocator_traits<Allocator>::template rebind_alloc<std::shared_ptr<Chunk>>>;
+
+    template<typename Other> // CircularBuffer const& or CircularBuffer&&
+    void assign_from(Other&& other)
+    {
+        constexpr bool is_move = std::is_rvalue_reference_v<Other&&>;
+
+        _max_size = other._max_size;
+        if (_allocator == other._allocator || !other._chunks)
+        {
+            _chunks = std::forward<Other>(other)._chunks;
+            _size   = other._size;
+        }
+        else
+        {
+            clear();
+            auto& chunks = mutable_chunks();
+            for (auto const& chunk : *other._chunks)
+            {
+                if (is_move && !is_shared(chunk)) // We must not steal the elements of a chunk that is still used by another CircularBuffer
+                    chunks.push_back(make_chunk(std::make_move_iterator(chunk->begin()), std::make_move_iterator(chunk->end())));
+                else
+                    chunks.push_back(make_chunk(chunk->begin(), chunk->end()));
+            }
+            _size = other._size;
+        }
+        if constexpr (is_move)
+            other.clear();
+    }
+
     template<typename Tref>
-    void push_back_impl(Tref&& t)
+    auto push_back_impl(Tref&& t) -> size_t
     {
-        _container.push_back(std::forward<Tref>(t));
-        shrink_left();
+        auto& chunks = mutable_chunks();
+        if (chunks.empty() || chunks.back()->size() == ChunkSize)
+            chunks.push_back(make_chunk());
+        mutable_chunk(chunks.size() - 1).push_back(std::forward<Tref>(t));
+        _size++;
+        return shrink_left();
     }
 
-    void shrink_left()
+    auto shrink_left() -> size_t
     {
-        while (_container.size() > _max_size)
+        const auto initial_size = _size;
+        while (_size > _max_size)
         {
-            _container.pop_front();
+            pop_front();
         }
+        return initial_size - _size;
     }
 
-    void shrink_while_preserving(iterator iterator_to_preserve)
+    auto shrink_while_preserving(size_t& index_to_preserve) -> size_t
     {
-        if (iterator_to_preserve == _container.end())
+        const auto initial_size = _size;
+        if (index_to_preserve == _size)
         {
             shrink_left();
+            index_to_preserve = _size;
         }
         else
         {
             if (_max_size == 0) // we need to be able to assume that _max_size > 0 in the else branch
             {
-                _container.clear();
+                clear();
+                index_to_preserve = 0;
             }
             else
             {
-                while (_container.size() > _max_size)
+                while (_size > _max_size)
                 {
-                    if (iterator_to_preserve != iterator_to_last_element()) // we know that _max_size > 0 so it is safe to call iterator_to_last_element()
+                    if (index_to_preserve != _size - 1) // we know that _max_size > 0 so _size - 1 is the index of the last element
                     {
-                        _container.pop_back();
+                        pop_back();
                     }
                     else
                     {
-                        _container.pop_front();
+                        pop_front();
+                        index_to_preserve--;
                     }
                 }
             }
         }
+        return initial_size - _size;
+    }
+
+    /// All the chunks are full, except the first one (because we remove elements from the front) and the last one (because we add elements to the back)
+    auto position_of(size_t index) const -> std::pair<size_t, size_t>
+    {
+        auto const first_chunk_size = _chunks->front()->size();
+        if (index < first_chunk_size)
+            return {0, index};
+        index -= first_chunk_size;
+        return {1 + index / ChunkSize, index % ChunkSize};
+    }
+
+    template<typename U>
+    static auto is_shared(std::shared_ptr<U> const& ptr) -> bool
+    {
+        if (ptr.use_count() > 1)
+            return true;
+        // Synchronizes with the release of the other references, that might have happened on another thread
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return false;
+    }
+
+    template<typename... Args>
+    auto make_chunk(Args&&... args) const -> std::shared_ptr<Chunk>
+    {
+        auto chunk = Chunk{_allocator};
+        chunk.reserve(ChunkSize);
+        if constexpr (sizeof...(Args) > 0)
+            chunk.insert(chunk.end(), std::forward<Args>(args)...);
+        return std::allocate_shared<Chunk>(_allocator, std::move(chunk));
+    }
+
+    auto mutable_chunks() -> Chunks&
+    {
+        if (!_chunks)
+            _chunks = std::allocate_shared<Chunks>(_allocator, Chunks{_allocator});
+        else if (is_shared(_chunks))
+            _chunks = std::allocate_shared<Chunks>(_allocator, Chunks{*_chunks, _allocator}); // Only copies the pointers to the chunks
+        return *_chunks;
     }
 
-    auto iterator_to_last_element()
+    auto mutable_chunk(size_t chunk_index) -> Chunk&
     {
-        assert(!_container.empty());
-        return std::prev(_container.end());
+        auto& chunk = mutable_chunks()[chunk_index];
+        if (is_shared(chunk))
+            chunk = make_chunk(chunk->begin(), chunk->end());
+        return *chunk;
     }
 
 private:
-    std::list<T> _container;
-    size_t       _max_size;
+    std::shared_ptr<Chunks> _chunks{};
+    size_t                  _size{0};
+    size_t                  _max_size;
+    Allocator               _allocator;
 };
 
 } // namespace cmd::internal
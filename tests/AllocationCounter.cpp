@@ -0,0 +1,43 @@
+#include "AllocationCounter.hpp"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+std::atomic<size_t> allocations{0};                  // NOLINT(*-avoid-non-const-global-variables)
+std::atomic<bool>   allocations_are_forbidden{false}; // NOLINT(*-avoid-non-const-global-variables)
+
+} // namespace
+
+namespace test {
+
+auto allocations_count() -> size_t
+{
+    return allocations.load(std::memory_order_relaxed);
+}
+
+void set_allocations_are_forbidden(bool forbidden)
+{
+    allocations_are_forbidden.store(forbidden, std::memory_order_relaxed);
+}
+
+} // namespace test
+
+auto operator new(std::size_t size) -> void*
+{
+    if (allocations_are_forbidden.load(std::memory_order_relaxed))
+        throw std::bad_alloc{};
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* ptr = std::malloc(size == 0 ? 1 : size)) // NOLINT(*-no-malloc, *-owning-memory)
+        return ptr;
+    throw std::bad_alloc{};
+}
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr); // NOLINT(*-no-malloc, *-owning-memory)
+}
+void operator delete(void* ptr, std::size_t) noexcept
+{
+    std::free(ptr); // NOLINT(*-no-malloc, *-owning-memory)
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+/// Counts the heap allocations made through the global operator new, which is replaced in AllocationCounter.cpp.
+/// This lets the tests pin down how many allocations the hot paths are allowed to make.
+
+#include <cstddef>
+
+namespace test {
+
+/// Number of allocations since the start of the program
+auto allocations_count() -> size_t;
+
+/// Number of allocations made while running the callback
+template<typename Callback>
+auto count_allocations(Callback&& callback) -> size_t
+{
+    auto const count_before = allocations_count();
+    callback();
+    return allocations_count() - count_before;
+}
+
+void set_allocations_are_forbidden(bool forbidden);
+
+/// Any heap allocation made while this is alive throws std::bad_alloc
+struct ForbidAllocations { // NOLINT(*-special-member-functions)
+    ForbidAllocations() { set_allocations_are_forbidden(true); }
+    ~ForbidAllocations() { set_allocations_are_forbidden(false); }
+};
+
+} // namespace test
@@ -0,0 +1,125 @@
+#include <cmd/cmd.hpp>
+#include <doctest/doctest.h>
+#include <algorithm>
+#include <string_view>
+#include <vector>
+#include "AllocationCounter.hpp"
+#include "ImGuiStub.hpp"
+
+#include <cmd/imgui.hpp> // Needs the ImGui declarations
+
+// Pins down how many allocations the hot paths make, so that regressions get caught by the tests rather than by profiling.
+
+namespace {
+
+struct Command_SetValue {
+    int new_value{};
+    int previous_value{};
+};
+
+struct Executor_SetValue {
+    int value{0};
+
+    void execute(Command_SetValue const& command) { value = command.new_value; }
+    void revert(Command_SetValue const& command) { value = command.previous_value; }
+};
+
+struct Merger_SetValue {
+    bool can_merge{true};
+
+    auto merge(Command_SetValue const& a, Command_SetValue const& b) const -> std::optional<Command_SetValue>
+    {
+        if (!can_merge)
+            return std::nullopt;
+        return Command_SetValue{.new_value = b.new_value, .previous_value = a.previous_value};
+    }
+};
+
+/// A new commit allocates its group of commands, from time to time a new chunk in the CircularBuffers of commits and of their metadata (the chunk itself and its storage),
+/// and even more rarely a new block in the std::deque that stores the chunks.
+/// NB: the very first push also has to create the lists of chunks, so it is not taken into account.
+constexpr size_t max_allocations_per_non_merging_push = 7;
+
+} // namespace
+
+TEST_CASE("Allocations")
+{
+    auto history  = cmd::History<Command_SetValue>{100};
+    auto executor = Executor_SetValue{};
+
+    SUBCASE("Merging a command doesn't allocate")
+    {
+        history.push(Command_SetValue{.new_value = 1, .previous_value = 0}, Merger_SetValue{});
+        auto const allocations = test::count_allocations([&]() {
+            for (int i = 1; i < 1000; ++i)
+                history.push(Command_SetValue{.new_value = i + 1, .previous_value = i}, Merger_SetValue{});
+        });
+        CHECK(allocations == 0);
+        CHECK(history.size() == 1);
+    }
+
+    SUBCASE("A non-merging push makes a bounded number of allocations")
+    {
+        history.push(Command_SetValue{.new_value = 0, .previous_value = 0}, Merger_SetValue{.can_merge = false});
+        size_t max_allocations = 0;
+        for (int i = 0; i < 1000; ++i) // Goes way past max_size, so that we also cover the evictions
+        {
+            history.start_new_commands_group();
+            max_allocations = std::max(max_allocations, test::count_allocations([&]() {
+                                           history.push(Command_SetValue{.new_value = i + 1, .previous_value = i}, Merger_SetValue{.can_merge = false});
+                                       }));
+        }
+        CHECK(max_allocations <= max_allocations_per_non_merging_push);
+        CHECK(history.size() == 100);
+    }
+
+    SUBCASE("A batch only allocates its group once")
+    {
+        history.push(Command_SetValue{.new_value = 0, .previous_value = 0}, Merger_SetValue{.can_merge = false});
+        history.start_new_commands_group();
+        auto commands = std::vector<Command_SetValue>{};
+        for (int i = 0; i < 1000; ++i)
+            commands.push_back(Command_SetValue{.new_value = i + 1, .previous_value = i});
+        auto const allocations = test::count_allocations([&]() {
+            history.push_batch(commands, Merger_SetValue{.can_merge = false});
+        });
+        CHECK(allocations <= max_allocations_per_non_merging_push + 1); // The first command goes through the regular push, then the group is resized once
+        CHECK(history.underlying_container().back().size() == 1000);
+    }
+
+    SUBCASE("Moving through the history doesn't allocate")
+    {
+        for (int i = 0; i < 300; ++i)
+        {
+            if (i % 3 == 0)
+                history.start_new_commands_group();
+            history.push(Command_SetValue{.new_value = i + 1, .previous_value = i}, Merger_SetValue{.can_merge = false});
+        }
+        auto const allocations = test::count_allocations([&]() {
+            for (int i = 0; i < 100; ++i)
+                history.move_backward(executor);
+            for (int i = 0; i < 100; ++i)
+                history.move_forward(executor);
+        });
+        CHECK(allocations == 0);
+        CHECK(executor.value == 300);
+    }
+
+    SUBCASE("Showing an unchanged history doesn't allocate")
+    {
+        for (int i = 0; i < 300; ++i)
+        {
+            if (i % 2 == 0)
+                history.start_new_commands_group();
+            history.push(Command_SetValue{.new_value = i + 1, .previous_value = i}, Merger_SetValue{.can_merge = false});
+        }
+        auto       ui                = cmd::UiForHistory{};
+        auto const command_to_string = [](Command_SetValue const&) -> std::string_view { return "Set value"; };
+        ui.imgui_show(history, command_to_string);
+        auto const allocations = test::count_allocations([&]() {
+            for (int i = 0; i < 10; ++i)
+                ui.imgui_show(history, command_to_string);
+        });
+        CHECK(allocations == 0);
+    }
+}
@@ -0,0 +1,63 @@
+#include <cmd/chrome_trace.hpp>
+#include <doctest/doctest.h>
+#include <sstream>
+
+namespace {
+
+struct Command_Rename {
+    std::string new_name;
+    std::string previous_name;
+};
+
+struct Executor_Rename {
+    std::string name;
+
+    void execute(Command_Rename const& command) { name = command.new_name; }
+    void revert(Command_Rename const& command) { name = command.previous_name; }
+};
+
+struct Merger_NeverMerge {
+    static auto merge(Command_Rename const&, Command_Rename const&) -> std::optional<Command_Rename>
+    {
+        return std::nullopt;
+    }
+};
+
+auto read_file(std::filesystem::path const& path) -> std::string
+{
+    auto file = std::ifstream{path};
+    auto ss   = std::stringstream{};
+    ss << file.rdbuf();
+    return ss.str();
+}
+
+} // namespace
+
+TEST_CASE("ChromeTracer records a span for each group and each command")
+{
+    auto const path = std::filesystem::temp_directory_path() / "cmd-tests-chrome-trace.json";
+    {
+        auto history = cmd::History<Command_Rename, cmd::ChromeTracer<Command_Rename>>{
+            10,
+            cmd::ChromeTracer<Command_Rename>{path, [](Command_Rename const& command) { return "Rename to \"" + command.new_name + "\""; }},
+        };
+        auto executor = Executor_Rename{};
+        history.push({.new_name = "a", .previous_name = ""}, Merger_NeverMerge{});
+        history.push({.new_name = "b", .previous_name = "a"}, Merger_NeverMerge{});
+        history.move_backward(executor);
+        history.move_forward(executor);
+        REQUIRE(executor.name == "b");
+        history.observer().stop_recording();
+        history.move_backward(executor); // Not recorded
+    }
+    auto const trace = read_file(path);
+    std::filesystem::remove(path);
+
+    CHECK(trace.front() == '[');
+    CHECK(trace.find(R"json("name":"move_backward (2 commands)","cat":"history","ph":"X")json") != std::string::npos);
+    CHECK(trace.find(R"json("name":"move_forward (2 commands)","cat":"history","ph":"X")json") != std::string::npos);
+    CHECK(trace.find(R"json("name":"Rename to \"b\"","cat":"revert")json") != std::string::npos);
+    CHECK(trace.find(R"json("name":"Rename to \"a\"","cat":"execute")json") != std::string::npos);
+    CHECK(trace.find("move_backward", trace.find("move_backward") + 1) == std::string::npos);
+    CHECK(trace.find("]") != std::string::npos);
+}
@@ -1,12 +1,14 @@
 #include "../src/internal/CircularBuffer.hpp"
 #include <doctest/doctest.h>
+#include <list>
+#include <vector>
 
 TEST_CASE("CircularBuffer::push_back() adds an element to the buffer, and removes the oldest one if max_size is reached")
 {
     auto buffer = cmd::internal::CircularBuffer<int>(3);
 
     const auto REQUIRE_BUFFER_TO_BE = [&](std::list<int> list) {
-        REQUIRE(buffer.underlying_container() == list);
+        REQUIRE(std::list<int>(buffer.begin(), buffer.end()) == list);
     };
 
     buffer.push_back(0);
@@ -21,4 +23,63 @@ TEST_CASE("CircularBuffer::push_back() adds an element to the buffer, and remove
     REQUIRE_BUFFER_TO_BE({2, 3, 4});
     buffer.set_max_size(2);
     REQUIRE_BUFFER_TO_BE({3, 4});
-}
\ No newline at end of file
+}
+
+TEST_CASE("CircularBuffer is copy-on-write")
+{
+    auto       buffer    = cmd::internal::CircularBuffer<std::vector<int>, 4>(100);
+    const auto as_vector = [](auto const& buf) {
+        auto res = std::vector<int>{};
+        for (auto const& element : buf)
+            res.push_back(element[0]);
+        return res;
+    };
+    for (int i = 0; i < 10; ++i)
+        buffer.push_back({i});
+
+    auto copy = buffer;
+    CHECK(&buffer[0] == &copy[0]); // Elements are shared
+
+    copy.mutable_at(5)[0] = 50;
+    copy.push_back({10});
+    CHECK(as_vector(buffer) == std::vector<int>{0, 1, 2, 3, 4, 5, 6, 7, 8, 9});
+    CHECK(as_vector(copy) == std::vector<int>{0, 1, 2, 3, 4, 50, 6, 7, 8, 9, 10});
+    CHECK(&buffer[0] == &copy[0]);   // Only the chunks that have been modified are duplicated
+    CHECK(&buffer[5] != &copy[5]);
+    CHECK(&buffer[9] != &copy[9]);
+
+    buffer.pop_front();
+    buffer.erase_all_starting_at(7);
+    CHECK(as_vector(buffer) == std::vector<int>{1, 2, 3, 4, 5, 6, 7});
+    CHECK(as_vector(copy) == std::vector<int>{0, 1, 2, 3, 4, 50, 6, 7, 8, 9, 10});
+
+    size_t index = 2;
+    copy.shrink_and_preserve_given_index(2, index); // Removes the elements after index first, then the ones before
+    CHECK(as_vector(copy) == std::vector<int>{1, 2});
+    CHECK(index == 1);
+    CHECK(copy.max_size() == 100);
+    CHECK(as_vector(buffer) == std::vector<int>{1, 2, 3, 4, 5, 6, 7});
+}
+
+TEST_CASE("CircularBuffer::erase() removes a range of elements")
+{
+    auto       buffer    = cmd::internal::CircularBuffer<int, 4>(100);
+    const auto as_vector = [&]() {
+        return std::vector<int>(buffer.begin(), buffer.end());
+    };
+    for (int i = 0; i < 20; ++i)
+        buffer.push_back(i);
+    auto const copy = buffer;
+
+    buffer.erase(2, 5); // Close to the front
+    CHECK(as_vector() == std::vector<int>{0, 1, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19});
+    buffer.erase(12, 15); // Close to the back
+    CHECK(as_vector() == std::vector<int>{0, 1, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 18, 19});
+    buffer.erase(3, 3);
+    CHECK(buffer.size() == 14);
+    buffer.push_back(20);
+    CHECK(as_vector() == std::vector<int>{0, 1, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 18, 19, 20});
+    CHECK(std::vector<int>(copy.begin(), copy.end()).size() == 20); // Copies are not affected
+    buffer.erase(0, buffer.size());
+    CHECK(buffer.is_empty());
+}
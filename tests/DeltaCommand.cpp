@@ -0,0 +1,183 @@
+#include <cmd/cmd.hpp>
+#include <doctest/doctest.h>
+#include <string>
+#include <vector>
+
+TEST_CASE("DeltaCommand")
+{
+    auto       gradient          = std::vector<float>(10'000, 1.f);
+    auto const original_gradient = gradient;
+
+    SUBCASE("The diff is proportional to what changed, and applies in both directions")
+    {
+        auto modified_gradient  = gradient;
+        modified_gradient[10]   = 2.f;
+        modified_gradient[11]   = 3.f;
+        modified_gradient[5000] = 4.f;
+        auto const command      = cmd::DeltaCommand<std::vector<float>>{gradient, modified_gradient};
+        CHECK(command.patch_size_in_bytes() < 30);
+        CHECK_FALSE(command.is_identity());
+
+        command.execute(gradient);
+        CHECK(gradient == modified_gradient);
+        command.revert(gradient);
+        CHECK(gradient == original_gradient);
+    }
+
+    SUBCASE("The size of the container can change")
+    {
+        auto const bigger  = std::vector<float>(10'050, 5.f);
+        auto const smaller = std::vector<float>(3, 1.f);
+
+        auto const grow = cmd::DeltaCommand<std::vector<float>>{gradient, bigger};
+        grow.execute(gradient);
+        CHECK(gradient == bigger);
+        grow.revert(gradient);
+        CHECK(gradient == original_gradient);
+
+        auto const shrink = cmd::DeltaCommand<std::vector<float>>{gradient, smaller};
+        shrink.execute(gradient);
+        CHECK(gradient == smaller);
+        shrink.revert(gradient);
+        CHECK(gradient == original_gradient);
+    }
+
+    SUBCASE("Merging composes the diffs, and detects when they cancel out")
+    {
+        auto step1 = gradient;
+        step1[3]   = 2.f;
+        step1.push_back(7.f);
+        auto step2 = step1;
+        step2[3]   = 1.f;
+        step2[200] = 8.f;
+
+        auto const command1 = cmd::DeltaCommand<std::vector<float>>{gradient, step1};
+        auto const command2 = cmd::DeltaCommand<std::vector<float>>{step1, step2};
+        auto       merged   = cmd::DeltaCommand<std::vector<float>>::merge(command1, command2);
+        REQUIRE(merged.is_merged());
+        REQUIRE_FALSE(merged.cancels_out());
+        merged.command().execute(gradient);
+        CHECK(gradient == step2);
+        merged.command().revert(gradient);
+        CHECK(gradient == original_gradient);
+
+        auto const back_to_original = cmd::DeltaCommand<std::vector<float>>{step2, original_gradient};
+        CHECK(cmd::DeltaCommand<std::vector<float>>::merge(merged.command(), back_to_original).cancels_out());
+        CHECK_FALSE(cmd::DeltaCommand<std::vector<float>>::merge(command2, command1).is_merged()); // Sizes don't match
+    }
+
+    SUBCASE("Trivially copyable objects")
+    {
+        struct Color {
+            float r, g, b, a;
+        };
+        auto       color   = Color{1.f, 0.f, 0.f, 1.f};
+        auto const command = cmd::DeltaCommand<Color>{color, Color{1.f, 0.5f, 0.f, 1.f}};
+        command.execute(color);
+        CHECK(color.g == 0.5f);
+        command.revert(color);
+        CHECK(color.g == 0.f);
+    }
+}
+
+namespace {
+
+/// Loads the given content into a DeltaCommand, like a corrupted file would
+struct Archive_OverwriteDelta {
+    std::vector<uint8_t> patch;
+    size_t               previous_size_in_bytes;
+    size_t               new_size_in_bytes;
+
+    void operator()(std::vector<uint8_t>& loaded_patch, size_t& loaded_previous_size_in_bytes, size_t& loaded_new_size_in_bytes) const
+    {
+        loaded_patch                  = patch;
+        loaded_previous_size_in_bytes = previous_size_in_bytes;
+        loaded_new_size_in_bytes      = new_size_in_bytes;
+    }
+};
+
+template<typename T>
+auto load_delta(Archive_OverwriteDelta archive) -> cmd::DeltaCommand<T>
+{
+    auto command = cmd::DeltaCommand<T>{};
+    command.serialize(archive);
+    return command;
+}
+
+} // namespace
+
+TEST_CASE("Corrupted DeltaCommands are rejected instead of writing out of bounds")
+{
+    auto       text     = std::string{"Hello"};
+    auto const original = text;
+
+    SUBCASE("A run that ends after the target")
+    {
+        auto const command = load_delta<std::string>({.patch = {3, 4, 'a', 'b', 'c', 'd'}, .previous_size_in_bytes = 5, .new_size_in_bytes = 5}); // Skips 3 bytes and then writes 4
+        CHECK_THROWS_AS(command.execute(text), std::out_of_range);
+        CHECK_THROWS_AS(command.revert(text), std::out_of_range);
+        CHECK(text == original);
+    }
+    SUBCASE("A run that is longer than the patch")
+    {
+        auto const command = load_delta<std::string>({.patch = {0, 100, 'a'}, .previous_size_in_bytes = 5, .new_size_in_bytes = 5});
+        CHECK_THROWS_AS(command.execute(text), std::out_of_range);
+        CHECK(text == original);
+        CHECK_THROWS_AS((void)cmd::DeltaMerger::merge(command, command), std::out_of_range);
+    }
+    SUBCASE("A varint that is cut")
+    {
+        auto const command = load_delta<std::string>({.patch = {0x80}, .previous_size_in_bytes = 5, .new_size_in_bytes = 5});
+        CHECK_THROWS_AS(command.execute(text), std::out_of_range);
+        CHECK(text == original);
+    }
+    SUBCASE("An offset that overflows")
+    {
+        auto const command = load_delta<std::string>({.patch = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x01, 1, 'a', 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x01, 1, 'a'}, .previous_size_in_bytes = 5, .new_size_in_bytes = 5});
+        CHECK_THROWS_AS(command.execute(text), std::out_of_range);
+        CHECK(text == original);
+    }
+    SUBCASE("A trivially copyable object of the wrong size")
+    {
+        auto       value   = uint32_t{7};
+        auto const command = load_delta<uint32_t>({.patch = {1, 1, 'a'}, .previous_size_in_bytes = 4, .new_size_in_bytes = 8});
+        CHECK_THROWS_AS(command.execute(value), std::out_of_range);
+        CHECK(value == 7);
+    }
+
+    auto const valid = load_delta<std::string>({.patch = {4, 1, 'a' ^ 'o'}, .previous_size_in_bytes = 5, .new_size_in_bytes = 5});
+    valid.execute(text);
+    CHECK(text == "Hella");
+}
+
+TEST_CASE("DeltaCommand in an History")
+{
+    auto       text     = std::string{"Hello World"};
+    auto       executor = cmd::DeltaExecutor<std::string>{text};
+    auto       history  = cmd::History<cmd::DeltaCommand<std::string>>{};
+    auto const edit     = [&](std::string const& new_text) {
+        history.push(cmd::DeltaCommand<std::string>{text, new_text}, cmd::DeltaMerger{});
+        text = new_text;
+    };
+
+    edit("Hello World!");
+    history.start_new_commands_group();
+    history.dont_merge_next_command();
+    edit("Hello Worlds!");
+    edit("Hello World!"); // Cancels out
+    REQUIRE(history.size() == 1);
+
+    edit("Goodbye");
+    history.move_backward(executor);
+    CHECK(text == "Hello World!");
+    history.move_backward(executor);
+    CHECK(text == "Hello World");
+    history.move_forward(executor);
+    history.move_forward(executor);
+    CHECK(text == "Goodbye");
+
+    static_assert(cmd::HasMemoryFootprintC<cmd::DeltaCommand<std::string>>);
+    auto const size_without_patches = history.memory_usage();
+    edit(std::string(1000, 'a'));
+    CHECK(history.memory_usage() >= size_without_patches + 1000); // The patch is taken into account
+}
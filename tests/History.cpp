@@ -1,6 +1,9 @@
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include <doctest/doctest.h>
 #include <cmd/cmd.hpp>
+#include <array>
+#include <memory_resource>
+#include <span>
 
 struct Command_SayHello {};
 struct Command_SayWorld {};
@@ -66,14 +69,16 @@ public:
         _value = command.previous_value;
     }
 
-private:
-    int _value = 0;
-    struct Merger {
+    struct NeverMerge {
         auto merge(Command_SetInt, Command_SetInt) const -> std::optional<Command_SetInt>
         {
             return std::nullopt;
         }
-    } _merger;
+    };
+
+private:
+    int        _value = 0;
+    NeverMerge _merger;
 };
 
 TEST_CASE("History")
@@ -228,4 +233,856 @@ TEST_CASE("Merging commands in an History")
         push();
         REQUIRE(history.size() == 2);
     }
-}
\ No newline at end of file
+}
+
+TEST_CASE("HistoryStats observer")
+{
+    auto       history  = cmd::History<Command_AlwaysMerge, cmd::HistoryStats>{2};
+    auto       executor = Executor_AlwaysMerge{};
+    const auto merger   = Merger_AlwaysMerge{};
+
+    history.push({}, merger);
+    history.push({}, merger); // Gets merged
+    history.dont_merge_next_command();
+    history.push({}, merger); // Not merged, but put in the same group
+    history.start_new_commands_group();
+    history.push({}, merger); // Merged with the last command of the previous group
+    history.dont_merge_next_command();
+    history.start_new_commands_group();
+    history.push({}, merger);
+    history.dont_merge_next_command();
+    history.start_new_commands_group();
+    history.push({}, merger); // Evicts the first group
+
+    auto const& stats = history.observer();
+    CHECK(stats.pushes_count() == 6);
+    CHECK(stats.merge_attempts_count() == 2);
+    CHECK(stats.merge_hits_count() == 2);
+    CHECK(stats.groups_count() == 3);
+    CHECK(stats.average_group_size() == doctest::Approx(4.f / 3.f));
+    CHECK(stats.commits_evicted_count() == 1);
+
+    history.move_backward(executor);
+    history.move_backward(executor);
+    history.move_forward(executor);
+    CHECK(stats.reverted_commands_count() == 2);
+    CHECK(stats.executed_commands_count() == 1);
+
+    history.set_max_size(1);
+    CHECK(stats.commits_evicted_count() == 2);
+}
+
+TEST_CASE("History::clone() gives an independent history")
+{
+    Executor_SetInt              executor{};
+    cmd::History<Command_SetInt> history{};
+    for (int i = 1; i <= 100; ++i)
+        executor.set_value(i, history);
+
+    auto copy = history.clone();
+    history.move_backward(executor);
+    executor.set_value(1000, history); // Discards the last commit of history, but not of copy
+    REQUIRE(history.size() == 100);
+    REQUIRE(copy.size() == 100);
+
+    auto copy_executor = Executor_SetInt{};
+    copy_executor.set_value(100, copy);
+    REQUIRE(copy.size() == 101);
+    copy.move_backward(copy_executor);
+    copy.move_backward(copy_executor);
+    CHECK(copy_executor.value() == 99);
+
+    history.move_backward(executor);
+    history.move_backward(executor);
+    CHECK(executor.value() == 98);
+}
+
+struct Merger_SetInt {
+    static auto merge(Command_SetInt a, Command_SetInt b) -> std::optional<Command_SetInt>
+    {
+        return Command_SetInt{.new_value = b.new_value, .previous_value = a.previous_value};
+    }
+};
+
+TEST_CASE("Compacting old commits")
+{
+    Executor_SetInt              executor{};
+    cmd::History<Command_SetInt> history{};
+    auto const                   undo_all = [&]() {
+        while (history.current_command_group_index() != 0)
+            history.move_backward(executor);
+    };
+
+    SUBCASE("Commands that can't be merged are all kept, but grouped in the same commit")
+    {
+        for (int i = 1; i <= 30; ++i)
+            executor.set_value(i, history);
+
+        auto const removed_count = history.compact_old_commits(Executor_SetInt::NeverMerge{}, {.recent_commits_count = 5, .commits_per_compacted_commit = 5}, 100);
+        CHECK(removed_count == 20);
+        REQUIRE(history.size() == 10);
+        for (size_t i = 0; i < 5; ++i)
+            CHECK(history.underlying_container()[i].size() == 5);
+        CHECK(history.compact_old_commits(Executor_SetInt::NeverMerge{}, {.recent_commits_count = 5, .commits_per_compacted_commit = 5}, 100) == 0); // Already compacted commits are not compacted again
+
+        for (int i = 29; i >= 25; --i)
+        {
+            history.move_backward(executor);
+            CHECK(executor.value() == i);
+        }
+        history.move_backward(executor);
+        CHECK(executor.value() == 20);
+        undo_all();
+        CHECK(executor.value() == 0);
+        history.move_forward(executor);
+        CHECK(executor.value() == 5);
+    }
+
+    SUBCASE("Compaction is incremental, and uses the merger")
+    {
+        for (int i = 1; i <= 30; ++i)
+            executor.set_value(i, history);
+
+        CHECK(history.compact_old_commits(Merger_SetInt{}, {.recent_commits_count = 10, .commits_per_compacted_commit = 10}) == 9);
+        REQUIRE(history.size() == 21);
+        CHECK(history.underlying_container()[0].size() == 1);
+        CHECK(history.compact_old_commits(Merger_SetInt{}, {.recent_commits_count = 10, .commits_per_compacted_commit = 10}) == 9);
+        CHECK(history.compact_old_commits(Merger_SetInt{}, {.recent_commits_count = 10, .commits_per_compacted_commit = 10}) == 0); // Not enough old commits left to make a full fold
+        REQUIRE(history.size() == 12);
+        undo_all();
+        CHECK(executor.value() == 0);
+        history.move_forward(executor);
+        CHECK(executor.value() == 10);
+    }
+
+    SUBCASE("The commits whose commands all cancel out are removed")
+    {
+        struct Merger_CancelOut {
+            static auto merge(Command_SetInt a, Command_SetInt b) -> cmd::MergeResult<Command_SetInt>
+            {
+                if (b.new_value == a.previous_value)
+                    return cmd::cancel_out;
+                return Command_SetInt{.new_value = b.new_value, .previous_value = a.previous_value};
+            }
+        };
+        for (int i : {1, 0, 2, 3, 4, 5})
+            executor.set_value(i, history);
+
+        CHECK(history.compact_old_commits(Merger_CancelOut{}, {.recent_commits_count = 2, .commits_per_compacted_commit = 2}, 100) == 3);
+        REQUIRE(history.size() == 3);
+        undo_all();
+        CHECK(executor.value() == 0);
+        history.move_forward(executor);
+        CHECK(executor.value() == 3);
+        history.move_forward(executor);
+        CHECK(executor.value() == 4);
+    }
+
+    SUBCASE("Commits after the current one are never compacted")
+    {
+        for (int i = 1; i <= 30; ++i)
+            executor.set_value(i, history);
+        for (int i = 0; i < 25; ++i)
+            history.move_backward(executor);
+
+        CHECK(history.compact_old_commits(Merger_SetInt{}, {.recent_commits_count = 0, .commits_per_compacted_commit = 2}, 100) == 2);
+        CHECK(executor.value() == 5);
+        history.move_forward(executor);
+        CHECK(executor.value() == 6);
+        history.move_backward(executor);
+        history.move_backward(executor);
+        CHECK(executor.value() == 4);
+    }
+
+    SUBCASE("When the history is full, push() compacts the old commits instead of evicting them")
+    {
+        auto       full_history = cmd::History<Command_SetInt, cmd::HistoryStats>{10};
+        auto const push         = [&](int value) {
+            full_history.push({.new_value = value, .previous_value = executor.value()}, Executor_SetInt::NeverMerge{});
+            full_history.start_new_commands_group();
+            executor.execute({.new_value = value, .previous_value = 0});
+        };
+        full_history.set_compaction_policy(cmd::CompactionPolicy{.recent_commits_count = 2, .commits_per_compacted_commit = 4});
+        for (int i = 1; i <= 20; ++i)
+            push(i);
+        CHECK(full_history.size() <= 10);
+        CHECK(full_history.observer().commits_evicted_count() == 0);
+        CHECK(full_history.observer().commits_compacted_count() == 20 - full_history.size());
+        while (full_history.current_command_group_index() != 0)
+            full_history.move_backward(executor);
+        CHECK(executor.value() == 0);
+
+        for (int i = 21; i <= 100; ++i) // Once everything is compacted we fall back to evicting commits
+            push(i);
+        CHECK(full_history.size() <= 10);
+        CHECK(full_history.observer().commits_evicted_count() > 0);
+    }
+}
+
+namespace {
+
+class CountingMemoryResource : public std::pmr::memory_resource {
+public:
+    size_t allocations_count{0};
+    size_t bytes_in_use{0};
+
+private:
+    auto do_allocate(size_t bytes, size_t alignment) -> void* override
+    {
+        allocations_count++;
+        bytes_in_use += bytes;
+        return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override
+    {
+        bytes_in_use -= bytes;
+        std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+    }
+    auto do_is_equal(std::pmr::memory_resource const& other) const noexcept -> bool override
+    {
+        return this == &other;
+    }
+};
+
+} // namespace
+
+TEST_CASE("pmr::History allocates all its memory through its memory resource")
+{
+    // Any allocation that goes through the default resource instead of ours will throw
+    auto* const previous_default_resource = std::pmr::set_default_resource(std::pmr::null_memory_resource());
+
+    auto resource = CountingMemoryResource{};
+    {
+        auto history  = cmd::pmr::History<Command_AlwaysMerge>{3, {}, &resource};
+        auto executor = Executor_AlwaysMerge{};
+        auto push     = [&]() {
+            history.dont_merge_next_command();
+            history.start_new_commands_group();
+            history.push({}, Merger_AlwaysMerge{});
+        };
+        CHECK_NOTHROW(push());
+        CHECK_NOTHROW(push());
+        CHECK_NOTHROW(push());
+        CHECK_NOTHROW(push()); // Evicts the oldest commit
+        auto copy = history.clone();
+        CHECK_NOTHROW(history.move_backward(executor));
+        CHECK_NOTHROW(push()); // Discards the redo branch, which is shared with copy
+        CHECK_NOTHROW(copy.set_max_size(1));
+        CHECK(history.size() == 3);
+        CHECK(copy.size() == 1);
+        CHECK(resource.allocations_count > 0);
+        CHECK(resource.bytes_in_use > 0);
+
+        // Assigning from an history that uses another resource copies the commits into our own resource
+        auto other_resource = CountingMemoryResource{};
+        auto other          = cmd::pmr::History<Command_AlwaysMerge>{10, {}, &other_resource};
+        CHECK_NOTHROW(other = history.clone());
+        CHECK(other.size() == 3);
+        CHECK(other.max_size() == 3);
+        CHECK(other.get_allocator().resource() == &other_resource);
+        CHECK(other_resource.bytes_in_use > 0);
+    }
+    CHECK(resource.bytes_in_use == 0);
+
+    std::pmr::set_default_resource(previous_default_resource);
+}
+
+struct Command_SetProperty {
+    size_t property;
+    int    new_value;
+    int    previous_value;
+};
+
+struct Executor_SetProperty {
+    std::array<int, 2> values{};
+
+    void execute(Command_SetProperty const& command) { values[command.property] = command.new_value; }
+    void revert(Command_SetProperty const& command) { values[command.property] = command.previous_value; }
+};
+
+struct Merger_SetProperty {
+    static auto merge(Command_SetProperty const& a, Command_SetProperty const& b) -> std::optional<Command_SetProperty>
+    {
+        if (a.property != b.property)
+            return std::nullopt;
+        return Command_SetProperty{.property = a.property, .new_value = b.new_value, .previous_value = a.previous_value};
+    }
+
+    static auto commutes(Command_SetProperty const& a, Command_SetProperty const& b) -> bool
+    {
+        return a.property != b.property;
+    }
+};
+
+TEST_CASE("Commands that commute are merged within a group once it is closed")
+{
+    static_assert(cmd::CommutativityHintC<Merger_SetProperty, Command_SetProperty>);
+    static_assert(!cmd::CommutativityHintC<Merger_AlwaysMerge, Command_AlwaysMerge>);
+
+    auto       history  = cmd::History<Command_SetProperty>{};
+    auto       executor = Executor_SetProperty{};
+    auto const set      = [&](size_t property, int value) {
+        history.push({.property = property, .new_value = value, .previous_value = executor.values[property]}, Merger_SetProperty{});
+        executor.values[property] = value;
+    };
+
+    for (int i = 1; i <= 10; ++i) // Interleaves edits of the two properties
+    {
+        set(0, i);
+        set(1, -i);
+    }
+    REQUIRE(history.underlying_container().back().size() == 20); // Nothing has been merged yet because the commands that are next to each other don't merge
+
+    SUBCASE("The group is compacted when we push into the next group")
+    {
+        history.start_new_commands_group();
+        set(0, 100);
+        REQUIRE(history.size() == 2);
+        CHECK(history.underlying_container()[0].size() == 2);
+
+        history.move_backward(executor);
+        history.move_backward(executor);
+        CHECK(executor.values == std::array<int, 2>{0, 0});
+        history.move_forward(executor);
+        CHECK(executor.values == std::array<int, 2>{10, -10});
+    }
+
+    SUBCASE("Commands pushed after dont_merge_next_command() are not merged with the previous ones")
+    {
+        history.dont_merge_next_command();
+        set(0, 11);
+        history.start_new_commands_group();
+        set(0, 100);
+        CHECK(history.underlying_container()[0].size() == 21);
+    }
+}
+
+struct Merger_SetIntThatCancelsOut {
+    static auto merge(Command_SetInt a, Command_SetInt b) -> cmd::MergeResult<Command_SetInt>
+    {
+        if (b.new_value == a.previous_value)
+            return cmd::cancel_out;
+        return Command_SetInt{.new_value = b.new_value, .previous_value = a.previous_value};
+    }
+};
+
+TEST_CASE("Commands that cancel out are removed from the history")
+{
+    auto       history  = cmd::History<Command_SetInt, cmd::HistoryStats>{};
+    auto       executor = Executor_SetInt{};
+    auto const set      = [&](int value) {
+        history.push({.new_value = value, .previous_value = executor.value()}, Merger_SetIntThatCancelsOut{});
+        executor.execute({.new_value = value, .previous_value = 0});
+    };
+
+    set(5);
+    history.start_new_commands_group();
+    history.dont_merge_next_command();
+
+    SUBCASE("The group is removed if it becomes empty")
+    {
+        set(7);
+        set(8);
+        set(5); // Back to the original value
+        CHECK(history.size() == 1);
+        CHECK(history.observer().merge_hits_count() == 2);
+
+        set(6); // Goes in a new group, and is not merged with the command of the previous group
+        CHECK(history.size() == 2);
+        history.move_backward(executor);
+        CHECK(executor.value() == 5);
+        history.move_backward(executor);
+        CHECK(executor.value() == 0);
+    }
+
+    SUBCASE("Only the command is removed if there are other commands in the group")
+    {
+        set(7);
+        history.dont_merge_next_command();
+        set(8);
+        set(7);
+        REQUIRE(history.size() == 2);
+        CHECK(history.underlying_container().back().size() == 1);
+        history.move_backward(executor);
+        CHECK(executor.value() == 5);
+    }
+
+    SUBCASE("Commands that cancel out are also removed by the compaction")
+    {
+        set(0);
+        REQUIRE(history.size() == 2);
+        history.start_new_commands_group();
+        history.dont_merge_next_command();
+        set(1);
+        history.start_new_commands_group();
+        CHECK(history.compact_old_commits(Merger_SetIntThatCancelsOut{}, {.recent_commits_count = 1, .commits_per_compacted_commit = 2}) == 2);
+        REQUIRE(history.size() == 1);
+        history.move_backward(executor);
+        CHECK(executor.value() == 0);
+    }
+}
+
+namespace {
+
+struct Executor_SetIntWithBatches {
+    int    value{0};
+    size_t executed_commands_count{0};
+    size_t batches_count{0};
+
+    void execute(Command_SetInt const& command)
+    {
+        value = command.new_value;
+        executed_commands_count++;
+    }
+
+    void execute_batch(std::span<Command_SetInt const> commands)
+    {
+        for (auto const& command : commands)
+            execute(command);
+        batches_count++;
+    }
+};
+
+struct Merger_SetIntOnlyOdd { // Only merges a command into an odd value, so that not everything collapses into a single command
+    static auto merge(Command_SetInt a, Command_SetInt b) -> std::optional<Command_SetInt>
+    {
+        if (a.new_value % 2 == 0)
+            return std::nullopt;
+        return Command_SetInt{.new_value = b.new_value, .previous_value = a.previous_value};
+    }
+};
+
+} // namespace
+
+TEST_CASE("History::replay()")
+{
+    auto history = cmd::History<Command_SetInt, cmd::HistoryStats>{100'000};
+    for (int i = 1; i <= 10'000; ++i)
+    {
+        history.push({.new_value = i, .previous_value = i - 1}, Executor_SetInt::NeverMerge{});
+        history.start_new_commands_group();
+    }
+    auto reverter = Executor_SetInt{};
+    while (history.current_command_group_index() != 0)
+        history.move_backward(reverter);
+
+    SUBCASE("Mergeable runs are coalesced before being executed, and given to the batch hook")
+    {
+        auto       executor         = Executor_SetIntWithBatches{};
+        size_t     progress_calls   = 0;
+        size_t     last_groups_done = 0;
+        auto const begin            = cmd::InstrumentationClock::now();
+        history.replay(executor, Merger_SetIntOnlyOdd{}, [&](size_t groups_done, size_t groups_count) {
+            CHECK(groups_count == 10'000);
+            CHECK(groups_done >= last_groups_done);
+            last_groups_done = groups_done;
+            progress_calls++;
+        });
+        CHECK(history.observer().executed_commands_count() == 5'000);
+        CHECK(history.observer().time_spent_executing() <= cmd::InstrumentationClock::now() - begin); // Each command only gets its share of the duration of its batch
+        CHECK(executor.value == 10'000);
+        CHECK(executor.executed_commands_count == 5'000);
+        CHECK(executor.batches_count == 5'000 / 256 + 1);
+        CHECK(last_groups_done == 10'000);
+        CHECK(progress_calls > 1);
+        CHECK(history.current_command_group_index() == history.size());
+
+        history.move_backward(reverter);
+        CHECK(reverter.value() == 9'999);
+    }
+
+    SUBCASE("Executors without a batch hook")
+    {
+        auto executor = Executor_SetInt{};
+        history.replay(executor, Merger_SetInt{});
+        CHECK(executor.value() == 10'000);
+        CHECK(history.observer().executed_commands_count() == 1);
+    }
+}
+
+TEST_CASE("Sliced undo / redo")
+{
+    auto history = cmd::History<Command_SetInt, cmd::HistoryStats>{};
+    for (int i = 1; i <= 1000; ++i) // All in a single group
+        history.push({.new_value = i, .previous_value = i - 1}, Executor_SetInt::NeverMerge{});
+    auto executor = Executor_SetInt{};
+    executor.execute({.new_value = 1000, .previous_value = 0});
+
+    SUBCASE("A group is processed across several calls")
+    {
+        auto const budget = cmd::SliceBudget{.max_commands_count = 300};
+        CHECK_FALSE(history.move_backward_sliced(executor, budget));
+        CHECK(history.is_in_transition());
+        CHECK(history.current_command_group_index() == 1);
+        CHECK(executor.value() == 700);
+        auto const progress = history.transition_progress();
+        REQUIRE(progress);
+        CHECK(progress->done_commands_count == 300);
+        CHECK(progress->commands_count == 1000);
+        CHECK_FALSE(progress->is_moving_forward);
+        CHECK(progress->ratio() == doctest::Approx(0.3f));
+        CHECK_FALSE(history.move_backward_sliced(executor, budget));
+        CHECK_FALSE(history.move_backward_sliced(executor, budget));
+        CHECK(history.move_backward_sliced(executor, budget));
+        CHECK_FALSE(history.is_in_transition());
+        CHECK_FALSE(history.transition_progress());
+        CHECK(history.current_command_group_index() == 0);
+        CHECK(executor.value() == 0);
+        CHECK(history.observer().move_backward_count() == 1);
+        CHECK(history.observer().reverted_commands_count() == 1000);
+
+        size_t calls_count = 0;
+        while (!history.move_forward_sliced(executor, cmd::SliceBudget{.max_duration = std::chrono::nanoseconds{0}}))
+            calls_count++;
+        CHECK(calls_count == 999); // We always process at least one command per call
+        CHECK(history.current_command_group_index() == 1);
+        CHECK(executor.value() == 1000);
+    }
+
+    SUBCASE("Without a budget the whole group is processed at once")
+    {
+        CHECK(history.move_backward_sliced(executor, cmd::SliceBudget{}));
+        CHECK(executor.value() == 0);
+        CHECK(history.move_backward_sliced(executor, cmd::SliceBudget{})); // Nothing left to undo
+        CHECK(history.current_command_group_index() == 0);
+    }
+
+    SUBCASE("Cancelling a transition goes back to where it started")
+    {
+        history.move_backward_sliced(executor, cmd::SliceBudget{.max_commands_count = 300});
+        history.cancel_transition(executor);
+        CHECK_FALSE(history.is_in_transition());
+        CHECK(history.current_command_group_index() == 1);
+        CHECK(executor.value() == 1000);
+
+        history.move_backward(executor);
+        history.move_forward_sliced(executor, cmd::SliceBudget{.max_commands_count = 10});
+        CHECK(executor.value() == 10);
+        history.cancel_transition(executor);
+        CHECK(history.current_command_group_index() == 0);
+        CHECK(executor.value() == 0);
+    }
+
+    SUBCASE("The commit we are moving through is never evicted")
+    {
+        history.move_backward_sliced(executor, cmd::SliceBudget{.max_commands_count = 300});
+        CHECK(history.evict_oldest_commit() == 0);
+        CHECK(history.size() == 1);
+        CHECK(history.move_backward_sliced(executor, cmd::SliceBudget{}));
+        CHECK(executor.value() == 0);
+    }
+}
+
+namespace {
+
+/// So that two consecutive commits can't have the same timestamp
+void wait_for_clock_to_tick()
+{
+    auto const start = cmd::InstrumentationClock::now();
+    while (cmd::InstrumentationClock::now() == start)
+    {
+    }
+}
+
+} // namespace
+
+TEST_CASE("Commits metadata")
+{
+    auto history        = cmd::History<Command_SetInt>{5};
+    auto executor       = Executor_SetInt{};
+    auto creation_times = std::vector<cmd::InstrumentationClock::time_point>{};
+    CHECK_FALSE(history.records_commit_times()); // So that we don't query the clock on every push unless we need to
+    executor.set_value(0, history);
+    CHECK(history.commit_metadata(0).creation_time == cmd::InstrumentationClock::time_point{});
+    history.move_backward(executor);
+    history.set_records_commit_times(true);
+    for (int i = 1; i <= 8; ++i)
+    {
+        wait_for_clock_to_tick();
+        executor.set_value(i, history);
+        creation_times.push_back(history.commit_metadata(history.size() - 1).creation_time);
+    }
+    auto const check_creation_times = [&](size_t first_commit) {
+        for (size_t i = 0; i < history.size(); ++i)
+            CHECK(history.commit_metadata(i).creation_time == creation_times[first_commit + i]);
+    };
+    check_creation_times(3);
+
+    SUBCASE("Adding a command to a commit updates its last modification time and its byte size")
+    {
+        history.push({.new_value = 9, .previous_value = 8}, Executor_SetInt::NeverMerge{});
+        auto const creation_time = history.commit_metadata(history.size() - 1).creation_time;
+        wait_for_clock_to_tick();
+        history.push({.new_value = 10, .previous_value = 9}, Executor_SetInt::NeverMerge{});
+        auto const& last = history.commit_metadata(history.size() - 1);
+        CHECK(last.creation_time == creation_time);
+        CHECK(last.last_modification_time > last.creation_time);
+        CHECK(last.byte_size > history.commit_metadata(0).byte_size);
+        size_t total = 0;
+        for (size_t i = 0; i < history.size(); ++i)
+            total += history.commit_metadata(i).byte_size;
+        CHECK(history.memory_usage() == total);
+    }
+
+    SUBCASE("The metadata follows the commits when they are removed")
+    {
+        history.move_backward(executor);
+        history.move_backward(executor);
+        history.set_max_size(3); // Removes one commit in the future and one in the past
+        check_creation_times(4);
+        history.evict_oldest_commit();
+        check_creation_times(5);
+        history.push({.new_value = 42, .previous_value = 6}, Executor_SetInt::NeverMerge{}); // Discards the commit in the future
+        CHECK(history.size() == 2);
+        CHECK(history.commit_metadata(0).creation_time == creation_times[5]);
+        CHECK(history.commit_metadata(1).creation_time > creation_times.back());
+    }
+
+    SUBCASE("Moving to a point in time")
+    {
+        history.move_to_time(creation_times[5], executor);
+        CHECK(history.current_command_group_index() == 3);
+        CHECK(executor.value() == 6);
+        history.move_to_time(creation_times[5] - std::chrono::nanoseconds{1}, executor);
+        CHECK(executor.value() == 5);
+        history.move_to_time(creation_times[0], executor); // Before the oldest commit that we still have
+        CHECK(history.current_command_group_index() == 0);
+        CHECK(executor.value() == 3);
+        history.move_to_time(cmd::InstrumentationClock::now(), executor);
+        CHECK(history.current_command_group_index() == history.size());
+        CHECK(executor.value() == 8);
+    }
+
+    SUBCASE("The creation times stay sorted when the recording gets disabled")
+    {
+        auto const last_recorded_time = history.commit_metadata(history.size() - 1).last_modification_time;
+        history.set_records_commit_times(false);
+        executor.set_value(9, history);
+        CHECK(history.commit_metadata(history.size() - 1).creation_time == last_recorded_time); // Not the epoch
+        history.set_records_commit_times(true);
+        wait_for_clock_to_tick();
+        executor.set_value(10, history);
+        for (size_t i = 1; i < history.size(); ++i)
+            CHECK(history.commit_metadata(i - 1).creation_time <= history.commit_metadata(i).creation_time);
+
+        history.move_to_time(last_recorded_time, executor); // Includes the commit that has been pushed while the recording was disabled
+        CHECK(executor.value() == 9);
+        history.move_to_time(creation_times.back(), executor);
+        CHECK(executor.value() == 8);
+    }
+}
+
+namespace {
+
+struct Merger_SetIntSometimes {
+    static auto merge(Command_SetInt a, Command_SetInt b) -> cmd::MergeResult<Command_SetInt>
+    {
+        if (b.new_value == a.previous_value)
+            return cmd::cancel_out;
+        if (a.new_value % 3 != 0)
+            return std::nullopt;
+        return Command_SetInt{.new_value = b.new_value, .previous_value = a.previous_value};
+    }
+};
+
+auto groups_of(cmd::History<Command_SetInt> const& history) -> std::vector<std::vector<int>>
+{
+    auto res = std::vector<std::vector<int>>{};
+    for (auto const& group : history.underlying_container())
+    {
+        res.emplace_back();
+        for (auto const& command : group)
+            res.back().push_back(command.new_value);
+    }
+    return res;
+}
+
+} // namespace
+
+TEST_CASE("History::push_batch()")
+{
+    auto commands = std::vector<Command_SetInt>{};
+    int  value    = 0;
+    for (int i = 0; i < 1000; ++i)
+    {
+        auto const new_value = i % 7 == 6 ? commands.back().previous_value : (i * 37) % 101; // Regularly cancels the previous command out
+        commands.push_back({.new_value = new_value, .previous_value = value});
+        value = new_value;
+    }
+
+    auto expected = cmd::History<Command_SetInt>{};
+    auto history  = cmd::History<Command_SetInt>{};
+    auto executor = Executor_SetInt{};
+    for (auto* h : {&expected, &history})
+    {
+        h->push({.new_value = 1, .previous_value = 0}, Merger_SetIntSometimes{});
+        h->start_new_commands_group();
+        h->push({.new_value = 2, .previous_value = 1}, Merger_SetIntSometimes{});
+        h->move_backward(executor); // The batch will discard this commit
+    }
+
+    SUBCASE("Is the same as pushing the commands one by one")
+    {
+        for (auto const& command : commands)
+            expected.push(command, Merger_SetIntSometimes{});
+        history.push_batch(commands, Merger_SetIntSometimes{});
+        CHECK(groups_of(history) == groups_of(expected));
+        CHECK(history.current_command_group_index() == expected.current_command_group_index());
+    }
+
+    SUBCASE("Commands can be moved in")
+    {
+        for (auto const& command : commands)
+            expected.push(command, Merger_SetIntSometimes{});
+        auto copy = commands;
+        history.push_batch(std::make_move_iterator(copy.begin()), std::make_move_iterator(copy.end()), Merger_SetIntSometimes{});
+        CHECK(groups_of(history) == groups_of(expected));
+    }
+
+    SUBCASE("Respects the groups and the max_size")
+    {
+        for (auto* h : {&expected, &history})
+            h->set_max_size(3);
+        for (size_t i = 0; i < 100; i += 10)
+        {
+            for (auto const& command : std::span{commands}.subspan(i, 10))
+                expected.push(command, Merger_SetIntSometimes{});
+            expected.start_new_commands_group();
+            history.push_batch(std::span{commands}.subspan(i, 10), Merger_SetIntSometimes{});
+            history.start_new_commands_group();
+        }
+        CHECK(history.size() == 3);
+        CHECK(groups_of(history) == groups_of(expected));
+        history.push_batch(std::span<Command_SetInt const>{}, Merger_SetIntSometimes{});
+        CHECK(groups_of(history) == groups_of(expected));
+    }
+}
+
+TEST_CASE("History::push_batch() when the first command cancels out")
+{
+    auto       expected     = cmd::History<Command_SetInt>{};
+    auto       history      = cmd::History<Command_SetInt>{};
+    auto const push_to_both = [&](Command_SetInt command) {
+        for (auto* h : {&expected, &history})
+            h->push(command, Merger_SetIntThatCancelsOut{});
+    };
+    auto const push_batch   = [&](std::vector<Command_SetInt> const& commands) {
+        for (auto const& command : commands)
+            expected.push(command, Merger_SetIntThatCancelsOut{});
+        history.push_batch(commands, Merger_SetIntThatCancelsOut{});
+        CHECK(groups_of(history) == groups_of(expected));
+        CHECK(history.current_command_group_index() == expected.current_command_group_index());
+    };
+    push_to_both({.new_value = 1, .previous_value = 0});
+
+    SUBCASE("with the only commit")
+    {
+        push_batch({{.new_value = 0, .previous_value = 1}, {.new_value = 2, .previous_value = 0}, {.new_value = 3, .previous_value = 2}});
+        CHECK(groups_of(history) == std::vector<std::vector<int>>{{3}});
+    }
+
+    SUBCASE("with the last of several commits")
+    {
+        for (auto* h : {&expected, &history})
+        {
+            h->start_new_commands_group();
+            h->dont_merge_next_command();
+        }
+        push_to_both({.new_value = 2, .previous_value = 1});
+        push_batch({{.new_value = 1, .previous_value = 2}, {.new_value = 5, .previous_value = 1}, {.new_value = 6, .previous_value = 5}});
+        CHECK(groups_of(history) == std::vector<std::vector<int>>{{1}, {6}}); // Not merged into the commit that was closed before
+    }
+
+    SUBCASE("with the last command of a group that holds several commands")
+    {
+        for (auto* h : {&expected, &history})
+            h->dont_merge_next_command();
+        push_to_both({.new_value = 2, .previous_value = 1});
+        push_batch({{.new_value = 1, .previous_value = 2}, {.new_value = 5, .previous_value = 1}, {.new_value = 6, .previous_value = 5}});
+        CHECK(groups_of(history) == std::vector<std::vector<int>>{{1, 6}}); // 5 is not merged with 1, because we don't know if they can be
+    }
+}
+
+namespace {
+
+struct Command_SetValues {
+    std::vector<int> values;
+};
+
+auto memory_footprint(Command_SetValues const& command) -> size_t
+{
+    return command.values.capacity() * sizeof(int);
+}
+
+struct Merger_SetValues {
+    static auto merge(Command_SetValues const& a, Command_SetValues const& b) -> cmd::MergeResult<Command_SetValues>
+    {
+        if (b.values.empty())
+            return cmd::cancel_out;
+        if (a.values.size() % 2 != 0)
+            return std::nullopt;
+        auto res = a;
+        res.values.insert(res.values.end(), b.values.begin(), b.values.end());
+        return res;
+    }
+};
+
+struct Executor_SetValues {
+    void execute(Command_SetValues const&) {}
+    void revert(Command_SetValues const&) {}
+};
+
+} // namespace
+
+TEST_CASE("History::memory_usage() is kept up to date")
+{
+    static_assert(cmd::HasMemoryFootprintC<Command_SetValues>);
+    static_assert(!cmd::HasMemoryFootprintC<Command_SetInt>);
+
+    auto       history      = cmd::History<Command_SetValues>{20};
+    auto       executor     = Executor_SetValues{};
+    auto const actual_usage = [&]() {
+        size_t res = 0;
+        for (auto const& group : history.underlying_container())
+        {
+            res += sizeof(group) + group.capacity() * sizeof(Command_SetValues);
+            for (auto const& command : group)
+                res += memory_footprint(command);
+        }
+        return res;
+    };
+    auto const push = [&](size_t values_count) {
+        history.push(Command_SetValues{std::vector<int>(values_count, 1)}, Merger_SetValues{});
+        CHECK(history.memory_usage() == actual_usage());
+    };
+
+    for (size_t i = 0; i < 100; ++i)
+    {
+        push(i % 5);
+        if (i % 7 == 0)
+            history.start_new_commands_group();
+        if (i % 11 == 0)
+        {
+            history.move_backward(executor);
+            CHECK(history.memory_usage() == actual_usage());
+        }
+    }
+    REQUIRE(history.size() > 6);
+
+    auto batch = std::vector<Command_SetValues>{};
+    for (size_t i = 0; i < 50; ++i)
+        batch.push_back(Command_SetValues{std::vector<int>(i % 4, 2)});
+    history.push_batch(batch, Merger_SetValues{});
+    CHECK(history.memory_usage() == actual_usage());
+
+    history.compact_old_commits(Merger_SetValues{}, {.recent_commits_count = 5, .commits_per_compacted_commit = 3}, 10);
+    CHECK(history.memory_usage() == actual_usage());
+
+    history.move_backward(executor);
+    history.set_max_size(6);
+    CHECK(history.memory_usage() == actual_usage());
+    history.evict_oldest_commit();
+    CHECK(history.memory_usage() == actual_usage());
+    history.shrink(0);
+    CHECK(history.memory_usage() == 0);
+}
@@ -0,0 +1,155 @@
+#include <cmd/cmd.hpp>
+#include <doctest/doctest.h>
+#include <optional>
+
+namespace {
+
+struct Command_SetInt {
+    int previous_value;
+    int new_value;
+};
+
+struct Executor_SetInt {
+    int value{0};
+
+    void execute(Command_SetInt const& command) { value = command.new_value; }
+    void revert(Command_SetInt const& command) { value = command.previous_value; }
+};
+
+struct Merger_NeverMerge {
+    static auto merge(Command_SetInt const&, Command_SetInt const&) -> std::optional<Command_SetInt>
+    {
+        return std::nullopt;
+    }
+};
+
+using Manager = cmd::HistoryManager<cmd::History<Command_SetInt>>;
+
+void push_commits(Manager& manager, Manager::HistoryId id, int count)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        manager.push(id, Command_SetInt{i, i + 1}, Merger_NeverMerge{});
+        manager.history(id).start_new_commands_group();
+    }
+}
+
+auto commit_memory_usage() -> size_t
+{
+    auto history = cmd::History<Command_SetInt>{};
+    history.push(Command_SetInt{0, 1}, Merger_NeverMerge{});
+    return history.memory_usage();
+}
+
+} // namespace
+
+TEST_CASE("HistoryManager")
+{
+    auto const commit_size = commit_memory_usage();
+
+    SUBCASE("Memory usage is the sum of the memory usage of all the histories")
+    {
+        auto       manager = Manager{1000 * commit_size};
+        auto const a       = manager.create_history();
+        auto const b       = manager.create_history(size_t{50});
+        push_commits(manager, a, 3);
+        push_commits(manager, b, 4);
+        CHECK(manager.memory_usage() == 7 * commit_size);
+        CHECK(manager.memory_usage() == manager.history(a).memory_usage() + manager.history(b).memory_usage());
+        auto const stats = manager.stats();
+        CHECK(stats.histories_count == 2);
+        CHECK(stats.commits_count == 7);
+        CHECK(stats.memory_usage == 7 * commit_size);
+        CHECK(stats.push.count == 7);
+        CHECK(stats.push.max >= stats.push.average());
+        manager.remove_history(b);
+        CHECK(manager.memory_usage() == 3 * commit_size);
+        CHECK_FALSE(manager.contains(b));
+    }
+
+    SUBCASE("References to the histories stay valid when other histories are created")
+    {
+        auto        manager = Manager{1000 * commit_size};
+        auto const  a       = manager.create_history();
+        auto const& history = manager.history(a);
+        for (int i = 0; i < 100; ++i)
+            manager.create_history();
+        push_commits(manager, a, 2);
+        CHECK(history.size() == 2);
+        CHECK(&history == &manager.history(a));
+    }
+
+    SUBCASE("The least recently focused histories are evicted first")
+    {
+        auto       manager = Manager{10 * commit_size};
+        auto const a       = manager.create_history();
+        auto const b       = manager.create_history();
+        auto const c       = manager.create_history();
+        push_commits(manager, a, 4);
+        push_commits(manager, b, 3);
+        push_commits(manager, c, 3);
+        CHECK(manager.stats().evicted_commits_count == 0);
+
+        manager.focus(a);
+        CHECK(manager.focused() == a);
+        push_commits(manager, a, 2); // b is now the least recently focused
+        CHECK(manager.history(a).size() == 6);
+        CHECK(manager.history(b).size() == 1);
+        CHECK(manager.history(c).size() == 3);
+        CHECK(manager.memory_usage() <= manager.memory_budget());
+        CHECK(manager.stats().evicted_commits_count == 2);
+
+        push_commits(manager, a, 3); // Empties b, then evicts from c
+        CHECK(manager.history(a).size() == 9);
+        CHECK(manager.history(b).size() == 0);
+        CHECK(manager.history(c).size() == 1);
+    }
+
+    SUBCASE("The largest histories are evicted first")
+    {
+        auto       manager = Manager{6 * commit_size, cmd::EvictionPolicy::LargestFirst};
+        auto const a       = manager.create_history();
+        auto const b       = manager.create_history();
+        push_commits(manager, a, 2);
+        push_commits(manager, b, 4);
+        push_commits(manager, a, 2);
+        CHECK(manager.history(a).size() == 3);
+        CHECK(manager.history(b).size() == 3);
+    }
+
+    SUBCASE("Evictions keep the current commit whenever possible")
+    {
+        auto       manager  = Manager{3 * commit_size};
+        auto       executor = Executor_SetInt{};
+        auto const a        = manager.create_history();
+        push_commits(manager, a, 3);
+        manager.move_backward(a, executor);
+        manager.move_backward(a, executor);
+        manager.set_memory_budget(2 * commit_size); // Evicts the commit in the past
+        CHECK(manager.history(a).size() == 2);
+        CHECK(manager.history(a).current_command_group_index() == 0);
+        manager.set_memory_budget(commit_size); // There is no commit in the past anymore, so evicts the one furthest away in the future
+        CHECK(manager.history(a).size() == 1);
+        manager.move_forward(a, executor);
+        CHECK(executor.value == 2);
+        auto const stats = manager.stats();
+        CHECK(stats.move_backward.count == 2);
+        CHECK(stats.move_forward.count == 1);
+    }
+
+    SUBCASE("A history that can't evict doesn't prevent the others from evicting")
+    {
+        auto       manager  = Manager{10 * commit_size};
+        auto       executor = Executor_SetInt{};
+        auto const a        = manager.create_history();
+        for (int i = 0; i < 2; ++i) // A single commit with several commands
+            manager.push(a, Command_SetInt{i, i + 1}, Merger_NeverMerge{});
+        auto const b = manager.create_history(); // a is now the least recently focused
+        push_commits(manager, b, 3);
+        REQUIRE_FALSE(manager.history(a).move_backward_sliced(executor, cmd::SliceBudget{.max_commands_count = 1}));
+        manager.set_memory_budget(manager.history(a).memory_usage() + commit_size); // The commit of a can't be evicted while it is in transition
+        CHECK(manager.history(a).size() == 1);
+        CHECK(manager.history(b).size() == 1);
+        CHECK(manager.memory_usage() <= manager.memory_budget());
+    }
+}
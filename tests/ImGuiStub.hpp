@@ -0,0 +1,46 @@
+#pragma once
+
+/// The tests don't link with Dear ImGui: these are no-op stand-ins for the few functions used by <cmd/imgui.hpp>, so that we can still check how the widgets behave.
+
+#include <cstddef>
+
+struct ImVec2 {
+    float x{};
+    float y{};
+};
+
+struct ImVec4 {
+    float x{};
+    float y{};
+    float z{};
+    float w{};
+};
+
+enum ImGuiDataType_ { ImGuiDataType_U64 };         // NOLINT(*-enum-size)
+enum ImGuiHoveredFlags_ { ImGuiHoveredFlags_ForTooltip }; // NOLINT(*-enum-size)
+
+namespace ImGui { // NOLINT(*-identifier-naming)
+
+inline void Separator() {}
+inline void SetScrollHereY(float) {}
+inline void SameLine() {}
+inline void Text(const char*, ...) {}
+inline void TextDisabled(const char*, ...) {}
+inline void TextColored(ImVec4 const&, const char*, ...) {}
+inline void TextUnformatted(const char*, const char* = nullptr) {}
+inline auto IsItemHovered(int = 0) -> bool { return false; }
+inline auto IsItemActive() -> bool { return false; }
+inline auto IsItemDeactivatedAfterEdit() -> bool { return false; }
+inline void BeginTooltip() {}
+inline void EndTooltip() {}
+inline void PushTextWrapPos(float = 0.f) {}
+inline void PopTextWrapPos() {}
+inline auto GetFontSize() -> float { return 13.f; }
+inline auto CalcTextSize(const char*) -> ImVec2 { return {}; }
+inline void SetNextItemWidth(float) {}
+inline void PushID(int) {}
+inline void PopID() {}
+inline auto InputScalar(const char*, int, void*) -> bool { return false; }
+inline auto SliderFloat(const char*, float*, float, float, const char* = "%.3f", int = 0) -> bool { return false; }
+
+} // namespace ImGui
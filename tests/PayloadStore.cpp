@@ -0,0 +1,129 @@
+#include <cmd/cmd.hpp>
+#include <doctest/doctest.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Command_Paste {
+    cmd::Interned<std::string> text;
+};
+
+struct Executor_Paste {
+    std::string document{};
+
+    void execute(Command_Paste const& command) { document += *command.text; }
+    void revert(Command_Paste const& command) { document.resize(document.size() - command.text->size()); }
+};
+
+struct Merger_NeverMerge {
+    static auto merge(Command_Paste const&, Command_Paste const&) -> std::optional<Command_Paste>
+    {
+        return std::nullopt;
+    }
+};
+
+/// Keeps track of the number of bytes that are still allocated
+template<typename T>
+struct CountingAllocator {
+    using value_type = T;
+
+    size_t* allocated_bytes;
+
+    explicit CountingAllocator(size_t* allocated_bytes)
+        : allocated_bytes{allocated_bytes}
+    {}
+    template<typename U>
+    explicit CountingAllocator(CountingAllocator<U> const& other)
+        : allocated_bytes{other.allocated_bytes}
+    {}
+
+    auto allocate(size_t n) -> T*
+    {
+        *allocated_bytes += n * sizeof(T);
+        return std::allocator<T>{}.allocate(n);
+    }
+    void deallocate(T* p, size_t n)
+    {
+        *allocated_bytes -= n * sizeof(T);
+        std::allocator<T>{}.deallocate(p, n);
+    }
+
+    friend auto operator==(CountingAllocator const&, CountingAllocator const&) -> bool = default;
+};
+
+} // namespace
+
+TEST_CASE("PayloadStore")
+{
+    auto store = cmd::PayloadStore<std::string>{};
+
+    SUBCASE("Equal payloads are only stored once")
+    {
+        auto const a = store.intern(std::string(1000, 'a'));
+        auto const b = store.intern(std::string(1000, 'a'));
+        auto const c = store.intern(std::string(1000, 'c'));
+        CHECK(a == b);
+        CHECK(&*a == &*b);
+        CHECK_FALSE(a == c);
+        CHECK(*c == std::string(1000, 'c'));
+        CHECK(store.size() == 2);
+    }
+
+    SUBCASE("Payloads are released when they are not used anymore")
+    {
+        {
+            auto const a = store.intern(std::string{"Hello"});
+            CHECK(store.size() == 1);
+        }
+        CHECK(store.size() == 0);
+        for (int i = 0; i < 100; ++i)
+            store.intern(std::to_string(i));
+        CHECK(store.size() == 0);
+    }
+
+    SUBCASE("Adopted payloads are released when they are not used anymore, even if they share their allocation with their reference count")
+    {
+        size_t allocated_bytes = 0;
+        {
+            auto const a = store.intern(std::allocate_shared<std::string const>(CountingAllocator<std::string>{&allocated_bytes}, "Hello"));
+            auto const b = store.intern(std::make_unique<std::string>("Hello"));
+            CHECK(&*a == &*b);
+            CHECK(allocated_bytes > 0);
+        }
+        CHECK(allocated_bytes == 0); // Not kept alive by the store
+        CHECK(store.size() == 0);
+
+        auto const c = store.intern(std::make_unique<std::string>("World"));
+        CHECK(*c == "World");
+        CHECK(store.size() == 1);
+    }
+
+    SUBCASE("Payloads are released when the last commit that uses them is evicted")
+    {
+        auto       history  = cmd::History<Command_Paste>{3};
+        auto       executor = Executor_Paste{};
+        auto const paste    = [&](std::string const& text) {
+            auto const command = Command_Paste{store.intern(text)};
+            executor.execute(command);
+            history.push(command, Merger_NeverMerge{});
+            history.start_new_commands_group();
+        };
+        paste("Hello");
+        paste("World");
+        paste("Hello");
+        CHECK(store.size() == 2);
+        paste("!"); // Evicts the first "Hello", but the third commit still uses it
+        CHECK(store.size() == 3);
+        paste("?"); // Evicts "World"
+        CHECK(store.size() == 3);
+        paste("."); // Evicts the last "Hello"
+        CHECK(store.size() == 3);
+
+        history.move_backward(executor);
+        history.move_backward(executor);
+        history.move_backward(executor);
+        CHECK(executor.document == "HelloWorldHello");
+    }
+}
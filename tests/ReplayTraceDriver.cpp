@@ -0,0 +1,92 @@
+// Replays a trace recorded with cmd::HistoryWithTraceRecorder, and prints the throughput, latency percentiles and peak memory usage of the chosen history.
+// Usage: cmd-replay-trace <trace-file> [history | undo-tree | static-history] [repetitions]
+
+#include <cmd/trace_recorder.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string_view>
+
+namespace {
+
+auto as_microseconds(cmd::InstrumentationClock::duration duration) -> double
+{
+    return std::chrono::duration<double, std::micro>{duration}.count();
+}
+
+void print_latencies(char const* name, cmd::LatencyPercentiles const& latencies)
+{
+    if (latencies.count == 0)
+        return;
+    std::printf(
+        "  %-14s %8zu ops | p50 %9.3f us | p90 %9.3f us | p99 %9.3f us | max %9.3f us\n",
+        name, latencies.count,
+        as_microseconds(latencies.p50), as_microseconds(latencies.p90), as_microseconds(latencies.p99), as_microseconds(latencies.max)
+    );
+}
+
+void print_report(cmd::TraceReplayReport const& report)
+{
+    std::printf("  %zu operations in %.3f ms (%.0f ops/s), recorded over %.3f s\n",
+                report.operations_count,
+                std::chrono::duration<double, std::milli>{report.total_duration}.count(),
+                report.operations_per_second(),
+                std::chrono::duration<double>{report.recorded_duration}.count());
+    print_latencies("push", report.push);
+    print_latencies("move_forward", report.move_forward);
+    print_latencies("move_backward", report.move_backward);
+    print_latencies("set_max_size", report.set_max_size);
+    if (report.peak_memory_usage != 0)
+        std::printf("  peak memory usage: %.3f Mb\n", static_cast<double>(report.peak_memory_usage) / 1'000'000.);
+}
+
+auto max_size_of(std::span<cmd::TraceEvent const> events) -> size_t
+{
+    if (!events.empty() && events.front().kind == cmd::TraceEventKind::SetMaxSize) // The recording starts with the max size of the recorded history
+        return static_cast<size_t>(events.front().max_size);
+    return 1000;
+}
+
+template<typename MakeHistory>
+auto replay(std::span<cmd::TraceEvent const> events, std::string_view backend, int repetitions, MakeHistory&& make_history) -> int
+{
+    std::printf("%zu events, replayed on %.*s\n", events.size(), static_cast<int>(backend.size()), backend.data());
+    for (int i = 0; i < repetitions; ++i)
+    {
+        auto history = make_history();
+        std::printf("Run %d/%d\n", i + 1, repetitions);
+        print_report(cmd::replay_trace(events, *history));
+    }
+    return EXIT_SUCCESS;
+}
+
+} // namespace
+
+auto main(int argc, char** argv) -> int
+{
+    if (argc < 2)
+    {
+        std::fprintf(stderr, "Usage: %s <trace-file> [history | undo-tree | static-history] [repetitions]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    auto const events = cmd::read_trace(argv[1]);
+    if (!events)
+    {
+        std::fprintf(stderr, "Could not read the trace \"%s\"\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+    auto const backend     = std::string_view{argc >= 3 ? argv[2] : "history"};
+    auto const repetitions = argc >= 4 ? std::max(std::atoi(argv[3]), 1) : 1;
+    auto const max_size    = max_size_of(*events);
+
+    if (backend == "history")
+        return replay(*events, backend, repetitions, [&]() { return std::make_unique<cmd::History<cmd::TraceCommand>>(max_size); });
+    if (backend == "undo-tree")
+        return replay(*events, backend, repetitions, [&]() { return std::make_unique<cmd::UndoTree<cmd::TraceCommand>>(max_size); });
+    if (backend == "static-history") // Heap-allocated because it stores all its commands inline
+        return replay(*events, backend, repetitions, []() { return std::make_unique<cmd::StaticHistory<cmd::TraceCommand, 1000, 64>>(); });
+
+    std::fprintf(stderr, "Unknown history \"%.*s\"\n", static_cast<int>(backend.size()), backend.data());
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include "../ser20.hpp"
+
+namespace ser20 {
+
+/// Writes the bytes as they are in memory
+class BinaryOutputArchive : public detail::OutputArchive<BinaryOutputArchive> {
+public:
+    explicit BinaryOutputArchive(std::ostream& stream)
+        : _stream{&stream}
+    {}
+
+    template<class T>
+        requires std::is_arithmetic_v<T>
+    void save_value(T const& value)
+    {
+        write(&value, sizeof(T));
+    }
+    template<class T>
+    void save_value(SizeTag<T> const& tag)
+    {
+        save_value(static_cast<size_type>(tag.size));
+    }
+    template<class T>
+    void save_value(BinaryData<T> const& data)
+    {
+        write(data.data, static_cast<std::size_t>(data.size));
+    }
+
+private:
+    void write(void const* data, std::size_t size)
+    {
+        auto const written = _stream->rdbuf()->sputn(static_cast<char const*>(data), static_cast<std::streamsize>(size));
+        if (static_cast<std::size_t>(written) != size)
+            throw Exception{"Failed to write " + std::to_string(size) + " bytes to output stream! Wrote " + std::to_string(written)};
+    }
+
+private:
+    std::ostream* _stream;
+};
+
+class BinaryInputArchive : public detail::InputArchive<BinaryInputArchive> {
+public:
+    explicit BinaryInputArchive(std::istream& stream)
+        : _stream{&stream}
+    {}
+
+    template<class T>
+        requires std::is_arithmetic_v<T>
+    void load_value(T& value)
+    {
+        read(&value, sizeof(T));
+    }
+    template<class T>
+    void load_value(SizeTag<T> const& tag)
+    {
+        auto size = size_type{};
+        load_value(size);
+        tag.size = static_cast<std::remove_cvref_t<T>>(size);
+    }
+    template<class T>
+    void load_value(BinaryData<T> const& data)
+    {
+        read(data.data, static_cast<std::size_t>(data.size));
+    }
+
+private:
+    void read(void* data, std::size_t size)
+    {
+        auto const read_count = _stream->rdbuf()->sgetn(static_cast<char*>(data), static_cast<std::streamsize>(size));
+        if (static_cast<std::size_t>(read_count) != size)
+            throw Exception{"Failed to read " + std::to_string(size) + " bytes from input stream! Read " + std::to_string(read_count)};
+    }
+
+private:
+    std::istream* _stream;
+};
+
+} // namespace ser20
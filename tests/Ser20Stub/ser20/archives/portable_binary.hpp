@@ -0,0 +1,119 @@
+#pragma once
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include "../ser20.hpp"
+
+namespace ser20 {
+
+namespace portable_binary_detail {
+
+/// Reverses the bytes of each element of `element_size` bytes
+inline void swap_bytes(char* data, std::size_t size, std::size_t element_size)
+{
+    for (std::size_t i = 0; i + element_size <= size; i += element_size)
+        std::reverse(data + i, data + i + element_size);
+}
+
+inline constexpr std::uint8_t is_little_endian = std::endian::native == std::endian::little ? 1 : 0;
+
+template<class T>
+constexpr auto element_size_of() -> std::size_t
+{
+    using Element = std::remove_cvref_t<std::remove_pointer_t<std::remove_cvref_t<T>>>;
+    if constexpr (std::is_void_v<Element>)
+        return 1;
+    else
+        return sizeof(Element);
+}
+
+} // namespace portable_binary_detail
+
+/// Writes a flag with the endianness of the machine first, and the reader swaps the bytes if its own endianness differs
+class PortableBinaryOutputArchive : public detail::OutputArchive<PortableBinaryOutputArchive> {
+public:
+    explicit PortableBinaryOutputArchive(std::ostream& stream)
+        : _stream{&stream}
+    {
+        save_value(portable_binary_detail::is_little_endian);
+    }
+
+    template<class T>
+        requires std::is_arithmetic_v<T>
+    void save_value(T const& value)
+    {
+        write(&value, sizeof(T));
+    }
+    template<class T>
+    void save_value(SizeTag<T> const& tag)
+    {
+        save_value(static_cast<size_type>(tag.size));
+    }
+    template<class T>
+    void save_value(BinaryData<T> const& data)
+    {
+        write(data.data, static_cast<std::size_t>(data.size));
+    }
+
+private:
+    void write(void const* data, std::size_t size)
+    {
+        auto const written = _stream->rdbuf()->sputn(static_cast<char const*>(data), static_cast<std::streamsize>(size));
+        if (static_cast<std::size_t>(written) != size)
+            throw Exception{"Failed to write " + std::to_string(size) + " bytes to output stream! Wrote " + std::to_string(written)};
+    }
+
+private:
+    std::ostream* _stream;
+};
+
+class PortableBinaryInputArchive : public detail::InputArchive<PortableBinaryInputArchive> {
+public:
+    explicit PortableBinaryInputArchive(std::istream& stream)
+        : _stream{&stream}
+    {
+        auto is_little_endian = std::uint8_t{};
+        read(&is_little_endian, 1, 1);
+        _should_swap_bytes = is_little_endian != portable_binary_detail::is_little_endian;
+    }
+
+    template<class T>
+        requires std::is_arithmetic_v<T>
+    void load_value(T& value)
+    {
+        read(&value, sizeof(T), sizeof(T));
+    }
+    template<class T>
+    void load_value(SizeTag<T> const& tag)
+    {
+        auto size = size_type{};
+        load_value(size);
+        tag.size = static_cast<std::remove_cvref_t<T>>(size);
+    }
+    template<class T>
+    void load_value(BinaryData<T> const& data)
+    {
+        read(data.data, static_cast<std::size_t>(data.size), portable_binary_detail::element_size_of<T>());
+    }
+
+private:
+    void read(void* data, std::size_t size, std::size_t element_size)
+    {
+        auto const read_count = _stream->rdbuf()->sgetn(static_cast<char*>(data), static_cast<std::streamsize>(size));
+        if (static_cast<std::size_t>(read_count) != size)
+            throw Exception{"Failed to read " + std::to_string(size) + " bytes from input stream! Read " + std::to_string(read_count)};
+        if (_should_swap_bytes && element_size > 1)
+            portable_binary_detail::swap_bytes(static_cast<char*>(data), size, element_size);
+    }
+
+private:
+    std::istream* _stream;
+    bool          _should_swap_bytes{false};
+};
+
+} // namespace ser20
@@ -0,0 +1,195 @@
+#pragma once
+
+/// The tests don't link with ser20: this is a small stand-in for the part of its API used by <cmd/ser20.hpp>.
+/// It encodes the data the same way as ser20's binary archives (sizes as 64-bit integers, shared pointers as an id followed by the pointee the first time it is seen, etc.), so that we can still check the formats written by the histories.
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+
+namespace ser20 {
+
+using size_type = std::uint64_t;
+
+struct Exception : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+template<class T>
+struct NameValuePair {
+    char const* name;
+    T           value;
+};
+
+template<class T>
+auto make_nvp(char const* name, T&& value) -> NameValuePair<T>
+{
+    return {name, std::forward<T>(value)};
+}
+
+template<class T>
+struct SizeTag {
+    T size;
+};
+
+template<class T>
+auto make_size_tag(T&& size) -> SizeTag<T>
+{
+    return {std::forward<T>(size)};
+}
+
+/// `size` is in bytes
+template<class T>
+struct BinaryData {
+    T             data;
+    std::uint64_t size;
+};
+
+template<class T>
+auto binary_data(T&& data, size_t size) -> BinaryData<T>
+{
+    return {std::forward<T>(data), static_cast<std::uint64_t>(size)};
+}
+
+/// Gives the archives access to the private serialization functions of the classes that befriend it
+class access {
+public:
+    template<class Archive, class T>
+    static auto member_serialize(Archive& archive, T& value) -> decltype(value.serialize(archive))
+    {
+        value.serialize(archive);
+    }
+    template<class Archive, class T>
+    static auto member_save(Archive& archive, T const& value) -> decltype(value.save(archive))
+    {
+        value.save(archive);
+    }
+    template<class Archive, class T>
+    static auto member_load(Archive& archive, T& value) -> decltype(value.load(archive))
+    {
+        value.load(archive);
+    }
+};
+
+namespace traits {
+
+/// Only knows about the types that the archives handle themselves (arithmetic types, sizes and binary data)
+template<class T, class Archive>
+struct is_output_serializable : std::bool_constant<requires(Archive& archive, T const& value) { archive.save_value(value); }> {};
+
+template<class T, class Archive>
+struct is_input_serializable : std::bool_constant<requires(Archive& archive, T const& value) { archive.load_value(value); }> {};
+
+} // namespace traits
+
+namespace detail {
+
+inline constexpr std::uint32_t msb_32bit = 0x80000000;
+
+template<class T>
+inline constexpr bool is_name_value_pair = false;
+template<class T>
+inline constexpr bool is_name_value_pair<NameValuePair<T>> = true;
+
+template<class Derived>
+class OutputArchive {
+public:
+    template<class... Ts>
+    auto operator()(Ts&&... values) -> Derived&
+    {
+        (process(values), ...);
+        return self();
+    }
+
+    /// Returns the id of the pointer, with its most significant bit set if this is the first time we see it
+    auto register_shared_pointer(void const* pointer) -> std::uint32_t
+    {
+        if (pointer == nullptr)
+            return 0;
+        auto const [it, is_new] = _shared_pointers_ids.try_emplace(pointer, static_cast<std::uint32_t>(_shared_pointers_ids.size() + 1));
+        return is_new ? (it->second | msb_32bit) : it->second;
+    }
+
+private:
+    template<class T>
+    void process(T const& value)
+    {
+        if constexpr (is_name_value_pair<T>)
+            process(value.value);
+        else if constexpr (requires { self().save_value(value); })
+            self().save_value(value);
+        else if constexpr (requires { access::member_serialize(self(), const_cast<T&>(value)); })
+            access::member_serialize(self(), const_cast<T&>(value));
+        else if constexpr (requires { access::member_save(self(), value); })
+            access::member_save(self(), value);
+        else if constexpr (requires { save(self(), value); })
+            save(self(), value);
+        else
+            serialize(self(), const_cast<T&>(value));
+    }
+
+    auto self() -> Derived& { return static_cast<Derived&>(*this); }
+
+private:
+    std::unordered_map<void const*, std::uint32_t> _shared_pointers_ids{};
+};
+
+template<class Derived>
+class InputArchive {
+public:
+    template<class... Ts>
+    auto operator()(Ts&&... values) -> Derived&
+    {
+        (process(values), ...);
+        return self();
+    }
+
+    void register_shared_pointer(std::uint32_t id, std::shared_ptr<void> pointer)
+    {
+        _shared_pointers[id & ~msb_32bit] = std::move(pointer);
+    }
+
+    auto get_shared_pointer(std::uint32_t id) const -> std::shared_ptr<void>
+    {
+        if (id == 0)
+            return nullptr;
+        auto const it = _shared_pointers.find(id);
+        if (it == _shared_pointers.end())
+            throw Exception{"Error while trying to deserialize a smart pointer. Could not find id " + std::to_string(id)};
+        return it->second;
+    }
+
+private:
+    template<class T>
+    void process(T& value)
+    {
+        if constexpr (is_name_value_pair<std::remove_const_t<T>>)
+            process(value.value);
+        else if constexpr (requires { self().load_value(value); })
+            self().load_value(value);
+        else if constexpr (requires { access::member_serialize(self(), value); })
+            access::member_serialize(self(), value);
+        else if constexpr (requires { access::member_load(self(), value); })
+            access::member_load(self(), value);
+        else if constexpr (requires { load(self(), value); })
+            load(self(), value);
+        else
+            serialize(self(), value);
+    }
+
+    auto self() -> Derived& { return static_cast<Derived&>(*this); }
+
+private:
+    std::unordered_map<std::uint32_t, std::shared_ptr<void>> _shared_pointers{};
+};
+
+} // namespace detail
+
+} // namespace ser20
@@ -0,0 +1,37 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include "../ser20.hpp"
+
+namespace ser20 {
+
+/// Each pointee is only written the first time the archive sees it, and the loaded pointers share their pointee again
+template<class Archive, class T>
+void save(Archive& archive, std::shared_ptr<T> const& pointer)
+{
+    auto const id = archive.register_shared_pointer(pointer.get());
+    archive(make_nvp("id", id));
+    if (id & detail::msb_32bit)
+        archive(make_nvp("data", *pointer));
+}
+
+template<class Archive, class T>
+void load(Archive& archive, std::shared_ptr<T>& pointer)
+{
+    auto id = std::uint32_t{};
+    archive(make_nvp("id", id));
+    if (id & detail::msb_32bit)
+    {
+        auto loaded = std::make_shared<std::remove_const_t<T>>();
+        archive.register_shared_pointer(id, loaded);
+        archive(make_nvp("data", *loaded));
+        pointer = std::move(loaded);
+    }
+    else
+    {
+        pointer = std::static_pointer_cast<T>(archive.get_shared_pointer(id));
+    }
+}
+
+} // namespace ser20
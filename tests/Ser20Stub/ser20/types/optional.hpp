@@ -0,0 +1,31 @@
+#pragma once
+#include <optional>
+#include "../ser20.hpp"
+
+namespace ser20 {
+
+template<class Archive, class T>
+void save(Archive& archive, std::optional<T> const& optional)
+{
+    archive(make_nvp("nullopt", !optional.has_value()));
+    if (optional)
+        archive(make_nvp("data", *optional));
+}
+
+template<class Archive, class T>
+void load(Archive& archive, std::optional<T>& optional)
+{
+    bool is_nullopt{};
+    archive(make_nvp("nullopt", is_nullopt));
+    if (is_nullopt)
+    {
+        optional.reset();
+    }
+    else
+    {
+        optional.emplace();
+        archive(make_nvp("data", *optional));
+    }
+}
+
+} // namespace ser20
@@ -0,0 +1,23 @@
+#pragma once
+#include <string>
+#include "../ser20.hpp"
+
+namespace ser20 {
+
+template<class Archive, class CharT, class Traits, class Alloc>
+void save(Archive& archive, std::basic_string<CharT, Traits, Alloc> const& string)
+{
+    archive(make_size_tag(static_cast<size_type>(string.size())));
+    archive(binary_data(string.data(), string.size() * sizeof(CharT)));
+}
+
+template<class Archive, class CharT, class Traits, class Alloc>
+void load(Archive& archive, std::basic_string<CharT, Traits, Alloc>& string)
+{
+    size_type size{};
+    archive(make_size_tag(size));
+    string.resize(static_cast<std::size_t>(size));
+    archive(binary_data(string.data(), static_cast<std::size_t>(size) * sizeof(CharT)));
+}
+
+} // namespace ser20
@@ -0,0 +1,25 @@
+#pragma once
+#include <vector>
+#include "../ser20.hpp"
+
+namespace ser20 {
+
+template<class Archive, class T, class Alloc>
+void save(Archive& archive, std::vector<T, Alloc> const& vector)
+{
+    archive(make_size_tag(static_cast<size_type>(vector.size())));
+    for (auto const& element : vector)
+        archive(element);
+}
+
+template<class Archive, class T, class Alloc>
+void load(Archive& archive, std::vector<T, Alloc>& vector)
+{
+    size_type size{};
+    archive(make_size_tag(size));
+    vector.resize(static_cast<std::size_t>(size));
+    for (auto& element : vector)
+        archive(element);
+}
+
+} // namespace ser20
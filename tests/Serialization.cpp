@@ -0,0 +1,440 @@
+#include <cmd/ser20.hpp>
+#include <doctest/doctest.h>
+#include <ser20/archives/binary.hpp>
+#include <ser20/archives/portable_binary.hpp>
+#include <ser20/types/string.hpp>
+#include <atomic>
+#include <limits>
+#include <memory_resource>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct Command_SetInt {
+    int new_value;
+    int previous_value;
+
+    friend auto operator==(Command_SetInt const&, Command_SetInt const&) -> bool = default;
+
+    template<class Archive>
+    void serialize(Archive& archive)
+    {
+        archive(new_value, previous_value);
+    }
+};
+
+struct Command_SetText {
+    std::string new_text;
+    std::string previous_text;
+
+    friend auto operator==(Command_SetText const&, Command_SetText const&) -> bool = default;
+
+    template<class Archive>
+    void serialize(Archive& archive)
+    {
+        archive(new_text, previous_text);
+    }
+};
+
+struct Command_Paste {
+    cmd::Interned<std::string> text;
+
+    template<class Archive>
+    void serialize(Archive& archive)
+    {
+        archive(text);
+    }
+};
+
+struct Executor_SetInt {
+    void execute(Command_SetInt const&) {}
+    void revert(Command_SetInt const&) {}
+};
+
+struct Executor_SetText {
+    void execute(Command_SetText const&) {}
+    void revert(Command_SetText const&) {}
+};
+
+struct Merger_NeverMerge {
+    template<typename CommandT>
+    static auto merge(CommandT const&, CommandT const&) -> std::optional<CommandT>
+    {
+        return std::nullopt;
+    }
+};
+
+template<typename OutputArchive, typename... Ts>
+auto save_to_bytes(Ts const&... values) -> std::string
+{
+    auto stream = std::ostringstream{std::ios::binary};
+    {
+        auto archive = OutputArchive{stream};
+        archive(values...);
+    }
+    return std::move(stream).str();
+}
+
+template<typename InputArchive, typename T>
+void load_from_bytes(std::string const& bytes, T& value)
+{
+    auto stream  = std::istringstream{bytes, std::ios::binary};
+    auto archive = InputArchive{stream};
+    archive(value);
+}
+
+/// Saves the history like HistoryWithSerialization does, in parallel chunks on the given pool
+template<typename OutputArchive, typename HistoryT>
+auto save_to_bytes_in_parallel(HistoryT const& history, cmd::SerializationThreadPool& thread_pool) -> std::string
+{
+    auto stream = std::ostringstream{std::ios::binary};
+    {
+        auto archive = OutputArchive{stream};
+        cmd::SerializationForHistory{.max_saved_size = history.max_size(), .thread_pool = &thread_pool}.save(archive, history);
+    }
+    return std::move(stream).str();
+}
+
+template<typename InputArchive, typename HistoryT>
+void load_from_bytes_in_parallel(std::string const& bytes, HistoryT& history, cmd::SerializationThreadPool& thread_pool)
+{
+    auto stream        = std::istringstream{bytes, std::ios::binary};
+    auto archive       = InputArchive{stream};
+    auto serialization = cmd::SerializationForHistory{.thread_pool = &thread_pool};
+    serialization.load(archive, history);
+}
+
+auto occurrences_count(std::string const& bytes, std::string const& pattern) -> size_t
+{
+    auto res = size_t{0};
+    for (auto position = bytes.find(pattern); position != std::string::npos; position = bytes.find(pattern, position + 1))
+        res++;
+    return res;
+}
+
+template<typename HistoryT>
+auto groups_of(HistoryT const& history)
+{
+    using CommandT = typename HistoryT::CommandGroup::value_type;
+    auto res       = std::vector<std::vector<CommandT>>{};
+    for (auto const& group : history.underlying_container())
+        res.emplace_back(group.begin(), group.end());
+    return res;
+}
+
+template<typename LoadedHistoryT, typename HistoryT>
+void check_same_history(LoadedHistoryT const& loaded, HistoryT const& history)
+{
+    CHECK(groups_of(loaded) == groups_of(history));
+    CHECK(loaded.current_command_group_index() == history.current_command_group_index());
+    CHECK(loaded.max_size() == history.max_size());
+}
+
+/// Not thread-safe, like a std::pmr::monotonic_buffer_resource
+class SingleThreadedMemoryResource : public std::pmr::memory_resource {
+public:
+    std::atomic<size_t> allocations_from_other_threads{0};
+
+private:
+    auto do_allocate(size_t bytes, size_t alignment) -> void* override
+    {
+        if (std::this_thread::get_id() != _thread)
+            allocations_from_other_threads++;
+        return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override
+    {
+        std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+    }
+    auto do_is_equal(std::pmr::memory_resource const& other) const noexcept -> bool override
+    {
+        return this == &other;
+    }
+
+private:
+    std::thread::id _thread{std::this_thread::get_id()};
+};
+
+} // namespace
+
+static_assert(cmd::internal::CanSaveCommandsAsBinaryBlock<ser20::BinaryOutputArchive, Command_SetInt>);
+static_assert(cmd::internal::CanLoadCommandsAsBinaryBlock<ser20::BinaryInputArchive, Command_SetInt>);
+static_assert(!cmd::internal::CanSaveCommandsAsBinaryBlock<ser20::PortableBinaryOutputArchive, Command_SetInt>); // The bytes of the commands depend on the endianness
+static_assert(!cmd::internal::CanLoadCommandsAsBinaryBlock<ser20::PortableBinaryInputArchive, Command_SetInt>);
+
+TEST_CASE("Serializing an History of trivially copyable commands")
+{
+    auto history  = cmd::History<Command_SetInt>{100};
+    auto executor = Executor_SetInt{};
+    for (int i = 1; i <= 10; ++i)
+    {
+        history.push(Command_SetInt{.new_value = i, .previous_value = i - 1}, Merger_NeverMerge{});
+        if (i % 3 != 1) // Groups of 2 and 1 commands
+            history.start_new_commands_group();
+    }
+    history.move_backward(executor);
+
+    SUBCASE("with a binary archive, as one block of bytes")
+    {
+        auto const bytes = save_to_bytes<ser20::BinaryOutputArchive>(history);
+        CHECK(bytes.size() == sizeof(uint64_t) + sizeof(uint32_t)                                   // The tag and the version of the format
+                                  + sizeof(uint64_t) + 7 * sizeof(uint64_t) + 10 * sizeof(Command_SetInt) // The groups
+                                  + sizeof(bool) + sizeof(size_t)                                         // The position in the history
+                                  + sizeof(size_t));                                                      // The max size
+        auto loaded = cmd::History<Command_SetInt>{};
+        load_from_bytes<ser20::BinaryInputArchive>(bytes, loaded);
+        check_same_history(loaded, history);
+    }
+    SUBCASE("files written one command at a time with a binary archive can still be loaded")
+    {
+        auto const bytes  = save_to_bytes<ser20::BinaryOutputArchive>(groups_of(history), history.unsafe_get_next_command_group_to_execute(), history.max_size());
+        auto       loaded = cmd::History<Command_SetInt>{};
+        load_from_bytes<ser20::BinaryInputArchive>(bytes, loaded);
+        check_same_history(loaded, history);
+    }
+    SUBCASE("an unknown version of the format is reported")
+    {
+        auto const bytes  = save_to_bytes<ser20::BinaryOutputArchive>(ser20::make_size_tag(std::numeric_limits<ser20::size_type>::max()), uint32_t{2});
+        auto       loaded = cmd::History<Command_SetInt>{};
+        CHECK_THROWS_AS(load_from_bytes<ser20::BinaryInputArchive>(bytes, loaded), ser20::Exception);
+    }
+    SUBCASE("corrupted sizes are reported before allocating more than what the file contains")
+    {
+        auto const tag_and_version = save_to_bytes<ser20::BinaryOutputArchive>(ser20::make_size_tag(std::numeric_limits<ser20::size_type>::max()), uint32_t{1});
+        auto       loaded          = cmd::History<Command_SetInt>{};
+        auto const huge_count      = uint64_t{1} << 60;
+        CHECK_THROWS_AS(load_from_bytes<ser20::BinaryInputArchive>(tag_and_version + save_to_bytes<ser20::BinaryOutputArchive>(ser20::make_size_tag(huge_count)), loaded), ser20::Exception);
+        CHECK_THROWS_AS(load_from_bytes<ser20::BinaryInputArchive>(tag_and_version + save_to_bytes<ser20::BinaryOutputArchive>(ser20::make_size_tag(ser20::size_type{1}), huge_count), loaded), ser20::Exception);
+        CHECK_THROWS_AS(load_from_bytes<ser20::BinaryInputArchive>(tag_and_version + save_to_bytes<ser20::BinaryOutputArchive>(ser20::make_size_tag(ser20::size_type{2}), huge_count, huge_count), loaded), ser20::Exception); // The total overflows
+    }
+    SUBCASE("with a portable archive, one command at a time so that the endianness doesn't matter")
+    {
+        auto const bytes = save_to_bytes<ser20::PortableBinaryOutputArchive>(history);
+        CHECK(bytes == save_to_bytes<ser20::PortableBinaryOutputArchive>(groups_of(history), history.unsafe_get_next_command_group_to_execute(), history.max_size()));
+        auto loaded = cmd::History<Command_SetInt>{};
+        load_from_bytes<ser20::PortableBinaryInputArchive>(bytes, loaded);
+        check_same_history(loaded, history);
+    }
+}
+
+TEST_CASE("Serializing a big History of commands that are not trivially copyable, in parallel chunks")
+{
+    auto history  = cmd::History<Command_SetText>{5'000};
+    auto executor = Executor_SetText{};
+    for (int i = 1; i <= 3'000; ++i)
+    {
+        history.push(Command_SetText{.new_text = std::to_string(i), .previous_text = std::to_string(i - 1)}, Merger_NeverMerge{});
+        if (i % 3 == 0)
+            history.start_new_commands_group();
+    }
+    history.move_backward(executor);
+    auto thread_pool = cmd::SerializationThreadPool{4};
+
+    SUBCASE("with a binary archive")
+    {
+        auto const bytes             = save_to_bytes_in_parallel<ser20::BinaryOutputArchive>(history, thread_pool);
+        auto       other_thread_pool = cmd::SerializationThreadPool{1};
+        CHECK(bytes == save_to_bytes_in_parallel<ser20::BinaryOutputArchive>(history, other_thread_pool)); // The chunks don't depend on the number of threads
+        auto loaded = cmd::History<Command_SetText>{};
+        load_from_bytes_in_parallel<ser20::BinaryInputArchive>(bytes, loaded, thread_pool);
+        check_same_history(loaded, history);
+    }
+    SUBCASE("with a portable archive")
+    {
+        auto const bytes  = save_to_bytes_in_parallel<ser20::PortableBinaryOutputArchive>(history, thread_pool);
+        auto       loaded = cmd::History<Command_SetText>{};
+        load_from_bytes_in_parallel<ser20::PortableBinaryInputArchive>(bytes, loaded, thread_pool);
+        check_same_history(loaded, history);
+    }
+    SUBCASE("files written with chunks can be loaded without a thread pool")
+    {
+        auto const bytes  = save_to_bytes_in_parallel<ser20::BinaryOutputArchive>(history, thread_pool);
+        auto       loaded = cmd::History<Command_SetText>{};
+        auto       stream = std::istringstream{bytes, std::ios::binary};
+        {
+            auto archive       = ser20::BinaryInputArchive{stream};
+            auto serialization = cmd::SerializationForHistory{};
+            serialization.load(archive, loaded);
+        }
+        check_same_history(loaded, history);
+    }
+    SUBCASE("files written one command at a time can still be loaded")
+    {
+        auto const bytes  = save_to_bytes<ser20::BinaryOutputArchive>(groups_of(history), history.unsafe_get_next_command_group_to_execute(), history.max_size(), history.max_size()); // Followed by the max saved size
+        auto       loaded = cmd::History<Command_SetText>{};
+        load_from_bytes_in_parallel<ser20::BinaryInputArchive>(bytes, loaded, thread_pool);
+        check_same_history(loaded, history);
+    }
+    SUBCASE("an unknown version of the format is reported")
+    {
+        auto const bytes  = save_to_bytes<ser20::BinaryOutputArchive>(ser20::make_size_tag(std::numeric_limits<ser20::size_type>::max()), uint32_t{2});
+        auto       loaded = cmd::History<Command_SetText>{};
+        CHECK_THROWS_AS(load_from_bytes<ser20::BinaryInputArchive>(bytes, loaded), ser20::Exception);
+    }
+    SUBCASE("corrupted counts and sizes are reported before allocating more than what the file contains")
+    {
+        auto const header = save_to_bytes<ser20::BinaryOutputArchive>(ser20::make_size_tag(std::numeric_limits<ser20::size_type>::max()), uint32_t{1});
+        auto const huge   = uint64_t{1} << 60;
+        auto const load   = [&](std::string const& bytes) {
+            auto loaded = cmd::History<Command_SetText>{};
+            load_from_bytes<ser20::BinaryInputArchive>(header + bytes, loaded);
+        };
+        auto const size_tag = [](uint64_t size) { return ser20::make_size_tag(static_cast<ser20::size_type>(size)); };
+        CHECK_THROWS_AS(load(save_to_bytes<ser20::BinaryOutputArchive>(size_tag(huge))), ser20::Exception);                                                     // Number of shared payloads
+        CHECK_THROWS_AS(load(save_to_bytes<ser20::BinaryOutputArchive>(size_tag(1), size_tag(huge))), ser20::Exception);                                        // Size of a shared payload
+        CHECK_THROWS_AS(load(save_to_bytes<ser20::BinaryOutputArchive>(size_tag(0), size_tag(huge))), ser20::Exception);                                        // Number of chunks
+        CHECK_THROWS_AS(load(save_to_bytes<ser20::BinaryOutputArchive>(size_tag(0), size_tag(1), huge, uint64_t{0}, size_tag(0))), ser20::Exception);           // Number of commits in a chunk
+        CHECK_THROWS_AS(load(save_to_bytes<ser20::BinaryOutputArchive>(size_tag(0), size_tag(1), uint64_t{1}, huge, size_tag(0))), ser20::Exception);           // Size of a chunk
+        CHECK_THROWS_AS(load(save_to_bytes<ser20::BinaryOutputArchive>(size_tag(0), size_tag(1), uint64_t{1}, uint64_t{0}, size_tag(huge))), ser20::Exception); // Number of payloads of a chunk
+    }
+    SUBCASE("a truncated file is reported")
+    {
+        auto bytes = save_to_bytes_in_parallel<ser20::BinaryOutputArchive>(history, thread_pool);
+        bytes.resize(bytes.size() - sizeof(size_t) - 20); // Cuts the end of the last chunk, not only the max saved size that follows the history
+        auto loaded = cmd::History<Command_SetText>{};
+        CHECK_THROWS_AS(load_from_bytes_in_parallel<ser20::BinaryInputArchive>(bytes, loaded, thread_pool), ser20::Exception);
+    }
+}
+
+TEST_CASE("Small histories of commands that are not trivially copyable are written one command at a time")
+{
+    auto history     = cmd::History<Command_SetText>{5'000};
+    auto thread_pool = cmd::SerializationThreadPool{4};
+    for (int i = 1; i <= 100; ++i)
+        history.push(Command_SetText{.new_text = std::to_string(i), .previous_text = std::to_string(i - 1)}, Merger_NeverMerge{});
+    auto const bytes = save_to_bytes_in_parallel<ser20::BinaryOutputArchive>(history, thread_pool);
+    CHECK(bytes == save_to_bytes<ser20::BinaryOutputArchive>(groups_of(history), history.unsafe_get_next_command_group_to_execute(), history.max_size(), history.max_size())); // Same format as before the parallel chunks existed
+    auto loaded = cmd::History<Command_SetText>{};
+    load_from_bytes_in_parallel<ser20::BinaryInputArchive>(bytes, loaded, thread_pool);
+    check_same_history(loaded, history);
+}
+
+TEST_CASE("Without a thread pool, big histories are written one command at a time")
+{
+    auto history = cmd::History<Command_SetText>{5'000};
+    for (int i = 1; i <= 3'000; ++i)
+        history.push(Command_SetText{.new_text = std::to_string(i), .previous_text = std::to_string(i - 1)}, Merger_NeverMerge{});
+    auto const bytes = save_to_bytes<ser20::BinaryOutputArchive>(history);
+    CHECK(bytes == save_to_bytes<ser20::BinaryOutputArchive>(groups_of(history), history.unsafe_get_next_command_group_to_execute(), history.max_size()));
+    auto loaded = cmd::History<Command_SetText>{};
+    load_from_bytes<ser20::BinaryInputArchive>(bytes, loaded);
+    check_same_history(loaded, history);
+}
+
+TEST_CASE("Interned payloads are only written once, and shared again when loading")
+{
+    auto const text_a = std::string(1000, 'a');
+    auto const text_b = std::string(1000, 'b');
+    auto       bytes  = std::string{};
+    {
+        auto history = cmd::History<Command_Paste>{};
+        auto store   = cmd::PayloadStore<std::string>{};
+        for (int i = 0; i < 100; ++i)
+            history.push(Command_Paste{.text = store.intern(i % 2 == 0 ? text_a : text_b)}, Merger_NeverMerge{});
+        bytes = save_to_bytes<ser20::BinaryOutputArchive>(history);
+    } // So that the loaded payloads can't be shared with the ones of this history through the PayloadStore
+    CHECK(occurrences_count(bytes, text_a) == 1);
+    CHECK(occurrences_count(bytes, text_b) == 1);
+
+    auto loaded = cmd::History<Command_Paste>{};
+    load_from_bytes<ser20::BinaryInputArchive>(bytes, loaded);
+    REQUIRE(loaded.size() == 1);
+    auto const& commands = loaded.underlying_container()[0];
+    REQUIRE(commands.size() == 100);
+    CHECK(*commands[0].text == text_a);
+    CHECK(*commands[1].text == text_b);
+    auto payloads_are_shared = true;
+    for (size_t i = 0; i < commands.size(); ++i)
+        payloads_are_shared &= &*commands[i].text == &*commands[i % 2].text;
+    CHECK(payloads_are_shared);
+    CHECK(cmd::PayloadStore<std::string>::global().intern(text_a) == commands[0].text); // The loaded payloads are interned in the global store
+}
+
+TEST_CASE("The payloads shared by several chunks are only written once")
+{
+    auto const text_a  = std::string(1000, 'a');
+    auto const text_b  = std::string(1000, 'b');
+    auto       history = cmd::History<Command_Paste>{5'000};
+    {
+        auto store = cmd::PayloadStore<std::string>{};
+        for (int i = 0; i < 3'000; ++i)
+        {
+            history.push(Command_Paste{.text = store.intern(i % 2 == 0 ? text_a : text_b)}, Merger_NeverMerge{});
+            history.start_new_commands_group();
+        }
+    }
+    auto       thread_pool = cmd::SerializationThreadPool{4};
+    auto const bytes       = save_to_bytes_in_parallel<ser20::BinaryOutputArchive>(history, thread_pool);
+    CHECK(bytes == save_to_bytes_in_parallel<ser20::BinaryOutputArchive>(history, thread_pool));
+    CHECK(occurrences_count(bytes, text_a) == 1);
+    CHECK(occurrences_count(bytes, text_b) == 1);
+    CHECK(bytes.size() < 3'000 * 100);
+
+    auto loaded = cmd::History<Command_Paste>{};
+    load_from_bytes_in_parallel<ser20::BinaryInputArchive>(bytes, loaded, thread_pool);
+    REQUIRE(loaded.size() == 3'000);
+    CHECK(*loaded.underlying_container()[0][0].text == text_a);
+    CHECK(*loaded.underlying_container()[1][0].text == text_b);
+    auto payloads_are_shared = true;
+    for (size_t i = 0; i < 3'000; ++i)
+        payloads_are_shared &= loaded.underlying_container()[i][0].text == loaded.underlying_container()[i % 2][0].text;
+    CHECK(payloads_are_shared);
+}
+
+TEST_CASE("Loading a big history doesn't use its allocator from several threads")
+{
+    auto history = cmd::History<Command_SetText>{5'000};
+    for (int i = 1; i <= 3'000; ++i)
+    {
+        history.push(Command_SetText{.new_text = std::to_string(i), .previous_text = std::to_string(i - 1)}, Merger_NeverMerge{});
+        history.start_new_commands_group();
+    }
+    auto       thread_pool = cmd::SerializationThreadPool{4};
+    auto const bytes       = save_to_bytes_in_parallel<ser20::BinaryOutputArchive>(history, thread_pool);
+
+    auto resource = SingleThreadedMemoryResource{};
+    auto loaded   = cmd::pmr::History<Command_SetText>{10, {}, &resource};
+    load_from_bytes_in_parallel<ser20::BinaryInputArchive>(bytes, loaded, thread_pool);
+    CHECK(resource.allocations_from_other_threads == 0);
+    check_same_history(loaded, history);
+}
+
+TEST_CASE("SerializationThreadPool")
+{
+    auto thread_pool = cmd::SerializationThreadPool{4};
+    CHECK(thread_pool.threads_count() == 4);
+
+    SUBCASE("runs the task once for each index")
+    {
+        auto counts = std::vector<std::atomic<int>>(1'000);
+        for (int i = 0; i < 3; ++i) // The threads are reused from one call to the next
+            thread_pool.for_each_index(counts.size(), [&](size_t index) { counts[index]++; });
+        auto all_ran_three_times = true;
+        for (auto const& count : counts)
+            all_ran_three_times &= count == 3;
+        CHECK(all_ran_three_times);
+    }
+    SUBCASE("rethrows the exceptions of the tasks, once they are all done")
+    {
+        auto done_count = std::atomic<size_t>{0};
+        CHECK_THROWS_AS(thread_pool.for_each_index(100, [&](size_t index) {
+            if (index == 10)
+                throw std::runtime_error{"Task failed"};
+            done_count++;
+        }),
+                        std::runtime_error);
+        CHECK(done_count == 99);
+    }
+    SUBCASE("can be used from one of its tasks")
+    {
+        auto count = std::atomic<size_t>{0};
+        thread_pool.for_each_index(8, [&](size_t) {
+            thread_pool.for_each_index(8, [&](size_t) { count++; });
+        });
+        CHECK(count == 64);
+    }
+}
@@ -0,0 +1,131 @@
+#include <cmd/cmd.hpp>
+#include <doctest/doctest.h>
+#include <vector>
+#include "AllocationCounter.hpp"
+
+namespace {
+
+struct Command_SetValue {
+    int new_value{};
+    int previous_value{};
+};
+
+struct Executor_SetValue {
+    int value{0};
+
+    constexpr void execute(Command_SetValue const& command) { value = command.new_value; }
+    constexpr void revert(Command_SetValue const& command) { value = command.previous_value; }
+};
+
+struct Merger_SetValue {
+    bool can_merge{true};
+
+    constexpr auto merge(Command_SetValue const& a, Command_SetValue const& b) const -> cmd::MergeResult<Command_SetValue>
+    {
+        if (!can_merge)
+            return std::nullopt;
+        if (b.new_value == a.previous_value)
+            return cmd::cancel_out;
+        return Command_SetValue{.new_value = b.new_value, .previous_value = a.previous_value};
+    }
+};
+
+template<size_t MaxCommits, size_t MaxCommandsPerGroup>
+constexpr void set(cmd::StaticHistory<Command_SetValue, MaxCommits, MaxCommandsPerGroup>& history, Executor_SetValue& executor, int value, Merger_SetValue merger = {.can_merge = false})
+{
+    history.push({.new_value = value, .previous_value = executor.value}, merger);
+    executor.value = value;
+}
+
+} // namespace
+
+TEST_CASE("StaticHistory is constexpr")
+{
+    constexpr auto value_after_undo = []() {
+        auto history  = cmd::StaticHistory<Command_SetValue, 4, 2>{};
+        auto executor = Executor_SetValue{};
+        for (int i = 1; i <= 10; ++i)
+        {
+            set(history, executor, i);
+            history.start_new_commands_group();
+        }
+        history.move_backward(executor);
+        history.move_backward(executor);
+        return executor.value;
+    }();
+    static_assert(value_after_undo == 8);
+    CHECK(value_after_undo == 8);
+}
+
+TEST_CASE("StaticHistory never allocates")
+{
+    auto history  = cmd::StaticHistory<Command_SetValue, 3, 2>{};
+    auto executor = Executor_SetValue{};
+
+    bool   threw = false;
+    size_t size_when_full{};
+    int    value_after_undoing_everything{};
+    int    value_after_redoing_everything{};
+    size_t size_after_cancellation{};
+    size_t size_after_full_group{};
+    try
+    {
+        auto const no_allocation = test::ForbidAllocations{};
+        for (int i = 1; i <= 5; ++i) // Evicts the oldest commits
+        {
+            set(history, executor, i);
+            history.start_new_commands_group();
+        }
+        size_when_full = history.size();
+        for (int i = 0; i < 5; ++i)
+            history.move_backward(executor);
+        value_after_undoing_everything = executor.value;
+        for (int i = 0; i < 5; ++i)
+            history.move_forward(executor);
+        value_after_redoing_everything = executor.value;
+
+        history.move_backward(executor);
+        set(history, executor, 10); // Discards the last commit
+        set(history, executor, 11, Merger_SetValue{});
+        set(history, executor, 4, Merger_SetValue{}); // Cancels out with the previous command
+        size_after_cancellation = history.size();
+
+        set(history, executor, 20);
+        history.dont_merge_next_command();
+        set(history, executor, 21);
+        history.dont_merge_next_command();
+        set(history, executor, 22); // The group is full so this goes into a new group
+        size_after_full_group = history.size();
+    }
+    catch (std::bad_alloc const&)
+    {
+        threw = true;
+    }
+    REQUIRE_FALSE(threw);
+    CHECK(size_when_full == 3);
+    CHECK(value_after_undoing_everything == 2);
+    CHECK(value_after_redoing_everything == 5);
+    CHECK(size_after_cancellation == 2);
+    CHECK(size_after_full_group == 3);
+    CHECK(history.command_group(1).size() == 2);
+    CHECK(history.command_group(2).size() == 1);
+    history.move_backward(executor);
+    CHECK(executor.value == 21);
+    history.move_backward(executor);
+    CHECK(executor.value == 4);
+}
+
+TEST_CASE("The allocation checker does catch allocations")
+{
+    bool threw = false;
+    try
+    {
+        auto const no_allocation = test::ForbidAllocations{};
+        auto       vector        = std::vector<int>(10);
+    }
+    catch (std::bad_alloc const&)
+    {
+        threw = true;
+    }
+    CHECK(threw);
+}
@@ -0,0 +1,140 @@
+#include <cmd/trace_recorder.hpp>
+#include <doctest/doctest.h>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Command_SetValue {
+    std::string target;
+    int         new_value;
+    int         previous_value;
+};
+
+struct Executor_SetValue {
+    void execute(Command_SetValue const&) {}
+    void revert(Command_SetValue const&) {}
+};
+
+/// Merges the commands that target the same value, like when dragging a slider
+struct Merger_SetValue {
+    static auto merge(Command_SetValue const& a, Command_SetValue const& b) -> cmd::MergeResult<Command_SetValue>
+    {
+        if (a.target != b.target)
+            return std::nullopt;
+        if (b.new_value == a.previous_value)
+            return cmd::cancel_out;
+        return Command_SetValue{.target = a.target, .new_value = b.new_value, .previous_value = a.previous_value};
+    }
+};
+
+void push_values(auto& history, std::string const& target, std::vector<int> const& values)
+{
+    for (size_t i = 1; i < values.size(); ++i)
+        history.push(Command_SetValue{.target = target, .new_value = values[i], .previous_value = values[i - 1]}, Merger_SetValue{});
+}
+
+} // namespace
+
+TEST_CASE("Recording and replaying a trace")
+{
+    auto const path     = std::filesystem::temp_directory_path() / "cmd-tests-trace.bin";
+    auto       history  = cmd::HistoryWithTraceRecorder<Command_SetValue>{50};
+    auto       executor = Executor_SetValue{};
+    history.push(Command_SetValue{.target = "not recorded", .new_value = 1, .previous_value = 0}, Merger_SetValue{});
+    history.start_recording(path);
+    history.start_new_commands_group();
+    push_values(history, "a", {0, 1, 2, 3}); // Dragging a slider
+    push_values(history, "a", {3, 0});       // Dragging it back to where it was
+    history.dont_merge_next_command();
+    push_values(history, "b", {0, 5});
+    history.move_backward(executor);
+    history.move_forward(executor);
+    history.set_max_size(10);
+    history.stop_recording();
+    history.move_backward(executor); // Not recorded
+
+    auto const events = cmd::read_trace(path);
+    std::filesystem::remove(path);
+    REQUIRE(events.has_value());
+    REQUIRE(events->size() == 11);
+    auto const outcome = [&](size_t i) { return (*events)[i].merge_outcome; };
+    CHECK((*events)[0].kind == cmd::TraceEventKind::SetMaxSize); // The max size that the history had when the recording started
+    CHECK((*events)[0].max_size == 50);
+    CHECK((*events)[1].kind == cmd::TraceEventKind::StartNewCommandsGroup);
+    CHECK(outcome(2) == cmd::TraceMergeOutcome::NotMerged); // With the command that was pushed before the recording started
+    CHECK(outcome(3) == cmd::TraceMergeOutcome::Merged);
+    CHECK(outcome(4) == cmd::TraceMergeOutcome::Merged);
+    CHECK(outcome(5) == cmd::TraceMergeOutcome::CancelledOut);
+    CHECK((*events)[6].kind == cmd::TraceEventKind::DontMergeNextCommand);
+    CHECK(outcome(7) == cmd::TraceMergeOutcome::NotTried);
+    CHECK((*events)[8].kind == cmd::TraceEventKind::MoveBackward);
+    CHECK((*events)[9].kind == cmd::TraceEventKind::MoveForward);
+    CHECK((*events)[10].kind == cmd::TraceEventKind::SetMaxSize);
+    CHECK((*events)[10].max_size == 10);
+    CHECK((*events)[2].command_size_in_bytes == sizeof(Command_SetValue));
+    CHECK((*events)[3].merged_command_size_in_bytes == sizeof(Command_SetValue));
+
+    SUBCASE("on an History")
+    {
+        auto       replayed = cmd::History<cmd::TraceCommand>{50};
+        auto const report   = cmd::replay_trace(*events, replayed);
+        CHECK(replayed.size() == 1); // The command pushed before the recording started is not part of the trace
+        CHECK(replayed.max_size() == 10);
+        CHECK(replayed.current_command_group_index() == 1);
+        CHECK(report.operations_count == 11);
+        CHECK(report.push.count == 5);
+        CHECK(report.move_backward.count == 1);
+        CHECK(report.move_forward.count == 1);
+        CHECK(report.set_max_size.count == 2);
+        CHECK(report.push.p50 <= report.push.p99);
+        CHECK(report.push.p99 <= report.push.max);
+        CHECK(report.peak_memory_usage > 0);
+        CHECK(report.operations_per_second() > 0.);
+    }
+    SUBCASE("on an UndoTree")
+    {
+        auto       replayed = cmd::UndoTree<cmd::TraceCommand>{50};
+        auto const report   = cmd::replay_trace(*events, replayed);
+        CHECK(replayed.size() == 1);
+        CHECK(report.peak_memory_usage > 0);
+    }
+    SUBCASE("on a StaticHistory")
+    {
+        auto       replayed = cmd::StaticHistory<cmd::TraceCommand, 5, 4>{};
+        auto const report   = cmd::replay_trace(*events, replayed);
+        CHECK(replayed.size() == 1);
+        CHECK(report.set_max_size.count == 2); // Ignored, but still measured
+        CHECK(report.peak_memory_usage == 0);
+    }
+}
+
+TEST_CASE("Malformed traces are rejected")
+{
+    auto const path = std::filesystem::temp_directory_path() / "cmd-tests-malformed-trace.bin";
+    {
+        auto history = cmd::HistoryWithTraceRecorder<Command_SetValue>{};
+        history.start_recording(path);
+        push_values(history, "a", {0, 1000});
+        history.set_max_size(1000);
+    }
+    auto bytes = std::string{};
+    {
+        auto file = std::ifstream{path, std::ios::binary};
+        bytes     = std::string{std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+    }
+    REQUIRE(cmd::read_trace(path).has_value());
+    {
+        auto file = std::ofstream{path, std::ios::binary};
+        file.write(bytes.data(), static_cast<std::streamsize>(bytes.size() - 1)); // Cuts the varint of the max size
+    }
+    CHECK_FALSE(cmd::read_trace(path).has_value());
+    {
+        auto file = std::ofstream{path, std::ios::binary};
+        file << "not a trace";
+    }
+    CHECK_FALSE(cmd::read_trace(path).has_value());
+    std::filesystem::remove(path);
+    CHECK_FALSE(cmd::read_trace(path).has_value());
+}
@@ -0,0 +1,249 @@
+#include <cmd/cmd.hpp>
+#include <doctest/doctest.h>
+
+namespace {
+
+struct Command_SetValue {
+    int new_value;
+    int previous_value;
+};
+
+struct Merger_NeverMerge {
+    static auto merge(Command_SetValue, Command_SetValue) -> std::optional<Command_SetValue>
+    {
+        return std::nullopt;
+    }
+};
+
+class Executor_SetValue {
+public:
+    int    value{0};
+    size_t executions_count{0};
+    size_t reverts_count{0};
+
+    void set_value(int n, cmd::UndoTree<Command_SetValue>& tree)
+    {
+        auto const command = Command_SetValue{.new_value = n, .previous_value = value};
+        value              = n;
+        tree.push(command, Merger_NeverMerge{});
+        tree.start_new_commands_group();
+    }
+
+    void execute(Command_SetValue command)
+    {
+        value = command.new_value;
+        executions_count++;
+    }
+
+    void revert(Command_SetValue command)
+    {
+        value = command.previous_value;
+        reverts_count++;
+    }
+};
+
+} // namespace
+
+TEST_CASE("UndoTree")
+{
+    auto executor = Executor_SetValue{};
+    auto tree     = cmd::UndoTree<Command_SetValue>{};
+
+    SUBCASE("Pushing after moving backward keeps the previous branch")
+    {
+        executor.set_value(1, tree);
+        executor.set_value(2, tree);
+        executor.set_value(3, tree);
+        auto const old_branch_tip = tree.current_commit();
+        tree.move_backward(executor);
+        tree.move_backward(executor);
+        REQUIRE(executor.value == 1);
+        executor.set_value(10, tree);
+        executor.set_value(20, tree);
+        REQUIRE(tree.size() == 5);
+
+        auto const branches = tree.branches();
+        REQUIRE(branches.size() == 2);
+        CHECK(branches[0].is_current);
+        CHECK(branches[0].length == 3);
+        CHECK(branches[1].tip == old_branch_tip);
+        CHECK_FALSE(branches[1].is_current);
+        CHECK(branches[1].length == 3);
+        CHECK(branches[1].common_length_with_current_branch == 1);
+
+        // Only the commits that are not shared are reverted / executed
+        executor.executions_count = 0;
+        executor.reverts_count    = 0;
+        REQUIRE(tree.switch_to_branch(old_branch_tip, executor));
+        CHECK(executor.value == 3);
+        CHECK(executor.reverts_count == 2);
+        CHECK(executor.executions_count == 2);
+        CHECK(tree.current_commit() == old_branch_tip);
+
+        // Moving forward follows the branch that was visited most recently
+        tree.move_backward(executor);
+        tree.move_backward(executor);
+        tree.move_forward(executor);
+        tree.move_forward(executor);
+        CHECK(executor.value == 3);
+        tree.move_backward(executor);
+        tree.move_backward(executor);
+        REQUIRE(tree.switch_to_branch(tree.branches()[1].tip, executor));
+        tree.move_backward(executor);
+        tree.move_backward(executor);
+        tree.move_forward(executor);
+        tree.move_forward(executor);
+        CHECK(executor.value == 20);
+
+        CHECK_FALSE(tree.switch_to_branch(12345, executor));
+    }
+
+    SUBCASE("When max_size is reached, the least recently visited branches are removed first")
+    {
+        tree.set_max_size(4);
+        executor.set_value(1, tree);
+        executor.set_value(2, tree);
+        tree.move_backward(executor);
+        executor.set_value(3, tree);
+        tree.move_backward(executor);
+        executor.set_value(4, tree);
+        REQUIRE(tree.size() == 4);
+        REQUIRE(tree.branches().size() == 3);
+        auto const memory_usage = tree.memory_usage();
+
+        executor.set_value(5, tree); // Removes the branch that ends with 2
+        CHECK(tree.size() == 4);
+        CHECK(tree.branches().size() == 2);
+        CHECK(tree.memory_usage() == memory_usage + sizeof(std::unique_ptr<int>)); // The removed commit has been freed, only the children of the commit 4 had to grow
+
+        executor.set_value(6, tree); // Removes the branch that ends with 3
+        CHECK(tree.branches().size() == 1);
+
+        executor.set_value(7, tree); // Removes the oldest commit
+        CHECK(tree.size() == 4);
+        tree.move_backward(executor);
+        tree.move_backward(executor);
+        tree.move_backward(executor);
+        tree.move_backward(executor);
+        CHECK(executor.value == 1);
+        tree.move_backward(executor); // no-op, the commit 0 -> 1 is gone
+        CHECK(executor.value == 1);
+
+        tree.set_max_size(2); // Removes the future, because there is no past anymore
+        tree.move_forward(executor);
+        tree.move_forward(executor);
+        tree.move_forward(executor); // no-op, the commits 5 -> 6 and 6 -> 7 are gone
+        CHECK(executor.value == 5);
+    }
+
+    SUBCASE("clone()")
+    {
+        executor.set_value(1, tree);
+        executor.set_value(2, tree);
+        tree.move_backward(executor);
+        executor.set_value(3, tree);
+        auto copy = tree.clone();
+        tree.move_backward(executor);
+        executor.set_value(4, tree);
+        CHECK(tree.branches().size() == 3);
+        CHECK(copy.branches().size() == 2);
+        CHECK(copy.current_commit() != tree.current_commit());
+
+        auto copy_executor = Executor_SetValue{.value = 3};
+        copy.move_backward(copy_executor);
+        CHECK(copy_executor.value == 1);
+        copy.move_forward(copy_executor);
+        CHECK(copy_executor.value == 3);
+    }
+}
+
+TEST_CASE("UndoTree removes the commits whose commands cancel out")
+{
+    struct Merger_CancelOut {
+        static auto merge(Command_SetValue a, Command_SetValue b) -> cmd::MergeResult<Command_SetValue>
+        {
+            if (b.new_value == a.previous_value)
+                return cmd::cancel_out;
+            return Command_SetValue{.new_value = b.new_value, .previous_value = a.previous_value};
+        }
+    };
+
+    auto       executor = Executor_SetValue{};
+    auto       tree     = cmd::UndoTree<Command_SetValue>{};
+    auto const set      = [&](int value) {
+        tree.push({.new_value = value, .previous_value = executor.value}, Merger_CancelOut{});
+        executor.value = value;
+    };
+
+    set(1);
+    tree.start_new_commands_group();
+    tree.dont_merge_next_command();
+    auto const first_commit = tree.current_commit();
+    set(2);
+    set(1);
+    CHECK(tree.size() == 1);
+    CHECK(tree.current_commit() == first_commit);
+
+    set(3); // Goes in a new commit
+    CHECK(tree.size() == 2);
+    tree.move_backward(executor);
+    CHECK(executor.value == 1);
+}
+
+namespace {
+
+struct Command_SetValues {
+    std::vector<int> values;
+};
+
+auto memory_footprint(Command_SetValues const& command) -> size_t
+{
+    return command.values.capacity() * sizeof(int);
+}
+
+struct Merger_SetValues {
+    static auto merge(Command_SetValues const&, Command_SetValues const& b) -> cmd::MergeResult<Command_SetValues>
+    {
+        if (b.values.empty())
+            return cmd::cancel_out;
+        return b;
+    }
+};
+
+} // namespace
+
+TEST_CASE("UndoTree::memory_usage() takes the memory footprint of the commands into account")
+{
+    static_assert(cmd::HasMemoryFootprintC<Command_SetValues>);
+
+    auto       tree          = cmd::UndoTree<Command_SetValues>{2};
+    auto const initial_usage = tree.memory_usage();
+    auto const push          = [&](size_t values_count) {
+        tree.push(Command_SetValues{std::vector<int>(values_count, 1)}, Merger_SetValues{});
+    };
+
+    push(1000);
+    auto const usage_with_one_commit = tree.memory_usage();
+    CHECK(usage_with_one_commit >= initial_usage + 1000 * sizeof(int));
+
+    push(10); // Merged into the previous command, which releases its 1000 values
+    CHECK(tree.memory_usage() == usage_with_one_commit - 990 * sizeof(int));
+
+    push(0); // Cancels out with the previous command, which removes the commit
+    CHECK(tree.memory_usage() <= initial_usage + sizeof(std::unique_ptr<int>) + sizeof(void*)); // Only the vectors of the root that had to grow are still there
+
+    for (size_t i = 0; i < 5; ++i)
+    {
+        tree.start_new_commands_group();
+        tree.dont_merge_next_command();
+        push(1000);
+    }
+    REQUIRE(tree.size() == 2);
+    auto const usage_at_max_size = tree.memory_usage();
+    CHECK(usage_at_max_size >= 2 * 1000 * sizeof(int));
+    CHECK(usage_at_max_size < 3 * 1000 * sizeof(int)); // The oldest commits have been freed
+
+    auto const copy = tree.clone();
+    CHECK(copy.memory_usage() >= 2 * 1000 * sizeof(int));
+    CHECK(copy.memory_usage() <= usage_at_max_size);
+}